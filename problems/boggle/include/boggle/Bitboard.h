@@ -0,0 +1,97 @@
+#ifndef BOGGLE_BITBOARD_H
+#define BOGGLE_BITBOARD_H
+
+// STL
+#include <stdint.h>
+#include <vector>
+
+// boggle
+#include <boggle/Point.h>
+
+namespace boggle {
+
+/**
+   A set of cells on a board, one bit per cell, laid out row by row so that
+   moving the whole set a step in any direction is a handful of shifts and
+   ORs over 64 cells at a time.
+
+   Each row is followed by a word of zeros, and there's a row of zeros above
+   and below the board, so nothing ever shifts off one row and onto another.
+*/
+class Bitboard {
+
+  public:
+
+  /**
+     An empty bitboard, for a board with no cells.
+  */
+  Bitboard();
+
+  /**
+     \param width the number of cells in each row.
+     \param height the number of rows.
+
+     An empty bitboard for a board of the given size.
+  */
+  Bitboard(const size_t width, const size_t height);
+
+  /**
+     \return the number of cells in each row.
+  */
+  size_t width() const { return _width; }
+
+  /**
+     \return the number of rows.
+  */
+  size_t height() const { return _height; }
+
+  /**
+     \param point the cell to change.
+     \param value whether the cell is in the set.
+  */
+  void set(const Point & point, const bool value);
+
+  /**
+     \param from the cells to step from. This may be the bitboard itself.
+     \param mask the cells it's okay to step onto.
+     \param scratch somewhere to put the intermediate results, which gets
+     resized to match as needed.
+     \return false if there are no cells left.
+
+     Sets this bitboard to every cell in `mask` which is next to a cell in
+     `from`. Cells in `from` count as next to themselves, so this is only ever
+     a superset of the cells a path could actually step onto.
+
+     All three bitboards (besides `scratch`) must be the same size, and only
+     the rows around those of `from` that have cells in them are looked at.
+
+     Built with AVX2 enabled, this works on 256 cells at a time.
+  */
+  bool expand(const Bitboard & from,
+              const Bitboard & mask,
+              Bitboard & scratch);
+
+  private:
+
+  /// \return the index of the first word of row `y`.
+  size_t row(const size_t y) const { return (y + 1) * _stride + 1; }
+
+  size_t _width;
+  size_t _height;
+
+  /// The number of words in a row, plus the one word of zeros after it.
+  size_t _stride;
+
+  /**
+     The rows which might have cells in them; none outside this range do.
+     `_first_row > _last_row` if the set is empty.
+  */
+  size_t _first_row;
+  size_t _last_row;
+
+  std::vector<uint64_t> _bits;
+};
+
+}
+
+#endif
@@ -1,10 +1,16 @@
+#ifndef BOGGLE_BOARD_H
+#define BOGGLE_BOARD_H
+
 // Project
+#include <boggle/Bitboard.h>
 #include <boggle/Point.h>
+#include <boggle/Trie.h>
 
 // STL
 #include <fstream>
+#include <istream>
 #include <list>
-#include <set>
+#include <stdint.h>
 #include <string>
 #include <vector>
 
@@ -23,16 +29,37 @@ class Board {
 
   /**
      Constructor which initializes the boggle::board from a string of newline
-     separated rows of letters. Expects the board to be N x N, meaning its width
-     must be the same length as its height.
+     separated rows of letters. Every row must be the same length, but there
+     can be any number of them, so the board needn't be square.
   */
   Board(const std::string & board_string);
 
   /**
-     \return int describing the length (and thus width) of the NxN 
-     boggle board.
+     Constructor which initializes the boggle::board from a stream of newline
+     separated rows of letters, as above.
+
+     Rows are read one at a time straight into the board, so loading never 
+     holds more than one row on top of the board. The board itself, with its
+     lists of each cell's neighbors and of where each letter is, takes around
+     40 bytes a cell.
+  */
+  Board(std::istream & board_stream);
+
+  /**
+     \return the number of letters in each row of the board.
+  */
+  size_t width() const { return _width; }
+
+  /**
+     \return the number of rows on the board.
+  */
+  size_t height() const { return _height; }
+
+  /**
+     \return int describing the length (and thus width) of an NxN 
+     boggle board. For a board that isn't square, this is its width.
    */
-  size_t length() const { return _length; }
+  size_t length() const { return _width; }
 
   /**
      \param x the x position of the letter you want to return
@@ -40,7 +67,7 @@ class Board {
      \return char the letter found at position (x,y).
 
      The board's top left corner is at (0,0) and its bottom right corner is at
-     (N-1,N-1), where N is the length/width of the board.
+     (W-1,H-1), where W and H are the width and height of the board.
   */
   const char & letter(const Point & point) const;
 
@@ -49,98 +76,570 @@ class Board {
   */
   std::string to_string() const;
 
+  /**
+     \param point the cell to change.
+     \param letter the letter to put there.
+
+     Changes a single letter on the board, keeping as much of the cache behind 
+     `exists(word)` as is still correct: prefixes whose paths went through 
+     `point` lose those paths, and prefixes the new letter might add paths to
+     are dropped. Everything else is left alone.
+
+     Any other Cache used with this board has to be `clear()`ed.
+
+     Throws a std::out_of_range if `point` isn't on the board.
+  */
+  void set_letter(const Point & point, const char letter);
+
+  /**
+     \param dictionary the dictionary `found` was solved against.
+     \param changed the cell most recently changed by `set_letter()`.
+     \param previous the letter `changed` held before that.
+     \param found the words found before the change, as `solve()` returned 
+     them, which is updated to what `solve()` would return now.
+
+     Brings the result of `solve()` up to date after a single `set_letter()`
+     without solving the whole board again. Found words using the old letter
+     are checked again, and only paths which could possibly pass through 
+     `changed` are searched for new words, so the work done is in proportion to
+     the change rather than to the board or the dictionary.
+  */
+  void resolve(const Trie & dictionary, 
+               const Point & changed,
+               const char previous,
+               std::vector<std::string> & found) const;
+
   /**
      \param word a string representing the word you want to know about.
      \return true if `word` exists (i.e., is playable) in the boggle board,
      false otherwise.
 
-     Note, this method populates a cache, which at the moment is unbound in how 
-     many resources it can consume.
+     Note, this method populates a cache, which is unbound in how many 
+     resources it can consume unless you give it a budget with 
+     `set_cache_budget()`.
 
      Beware.
   */
   bool exists(const std::string & word) const;
 
+  /**
+     Counters describing how the cache behind `exists()` is doing.
+  */
+  struct CacheStats {
+    CacheStats();
+
+    /**
+       Adds another cache's counters to these. The peaks are summed too, 
+       which is what they'd add up to if every cache peaked at once.
+    */
+    CacheStats & operator+=(const CacheStats & other);
+
+    /// Lookups which found some prefix of the word already in the cache.
+    size_t hits;
+
+    /// Lookups which had to start from the word's first letter.
+    size_t misses;
+
+    /// Prefixes dropped from the cache to stay within the budget.
+    size_t evictions;
+
+    /// Roughly how many bytes the cache is holding right now.
+    size_t bytes;
+
+    /// Words `exists()` has been asked about.
+    size_t checked;
+
+    /**
+       Words ruled out by the letter, pair and bitboard checks, before the 
+       cache was looked at.
+    */
+    size_t filtered;
+
+    /// Element `i` is how many hits found a prefix `i` letters long.
+    std::vector<size_t> hits_by_length;
+
+    /// Paths added to the cache, over all prefixes.
+    size_t game_states;
+
+    /// Prefixes in the cache right now.
+    size_t entries;
+
+    /// The most prefixes, and bytes, the cache has held at once.
+    size_t peak_entries;
+    size_t peak_bytes;
+
+    /**
+       Only counted once timing is turned on with `Cache::set_timing()`. 
+       Element `i` of `latency` is how many calls to `exists()` took from 
+       `2^i` up to `2^(i+1)` nanoseconds, except that element 0 also counts 
+       calls which took no time at all.
+    */
+    static const size_t latency_buckets = 40;
+    size_t latency[latency_buckets];
+
+    /// The total time, in nanoseconds, of the calls in `latency`.
+    uint64_t nanoseconds;
+  };
+
+  /**
+     The prefixes, and the paths spelling them, which `exists()` remembers
+     between calls.
+
+     Every Board keeps one of these for `exists(word)`, which makes that 
+     unsafe to call from more than one thread at once. Instead, each thread can
+     bring a Cache of its own to `exists(word, cache)`, which only ever reads
+     from the Board.
+  */
+  class Cache {
+    public:
+    Cache();
+
+    /**
+       \param bytes roughly how much memory the cache may hold, or 0 for no 
+       limit, which is the default.
+
+       Whenever the cache grows past `bytes`, the least recently used prefixes
+       are dropped until it fits again. Dropping a prefix never changes the
+       answer `exists()` gives, it only means that prefix has to be searched 
+       for again.
+    */
+    void set_budget(const size_t bytes);
+
+    /**
+       \return the counters for the cache.
+    */
+    const CacheStats & stats() const { return _stats; }
+
+    /**
+       \param timing whether to time every call to `exists()` with this 
+       cache, for `CacheStats::latency`. Off by default, since reading the 
+       clock twice costs about as much as a call that hits the cache.
+    */
+    void set_timing(const bool timing) { _timing = timing; }
+
+    /**
+       Forgets everything in the cache, keeping its counters and budget.
+    */
+    void clear();
+
+    private:
+    friend class Board;
+
+    /**
+       A class to encapsulate the state of the game for every path spelling 
+       some given word.
+
+       Rather than an object per path, each path is a slot in two flat arrays:
+       the cell the path ends on, and a fixed width bitset of the cells it has
+       visited. On boards of up to 64 cells that bitset is a single 
+       `uint64_t`; bigger boards just use more words per slot. Either way, 
+       extending a path copies a few words onto the end of an array rather 
+       than allocating.
+    */
+    class GameStates {
+      public:
+      GameStates(const size_t board_size);
+
+      /// Adds a path which has only visited `board_index`.
+      void push_back(const unsigned int board_index);
+
+      /// Adds the path `state` of `states`, extended onto `board_index`.
+      void push_back(const GameStates & states, 
+                     const size_t state, 
+                     const unsigned int board_index);
+
+      bool visited(const size_t state, const unsigned int board_index) const {
+        return (_visited[state * _words + board_index / 64] >> 
+                (board_index % 64)) & 1;
+      }
+
+      unsigned int last_letter(const size_t state) const { 
+        return _last_letters[state];
+      }
+
+      size_t size() const { return _last_letters.size(); }
+
+      bool empty() const { return _last_letters.empty(); }
+
+      /// Drops every path which has visited `board_index`.
+      void remove_visiting(const unsigned int board_index);
+
+      /// Trims any spare capacity once no more paths will be added.
+      void shrink_to_fit();
+
+      /// How much memory the paths are taking up.
+      size_t bytes() const;
+
+      private:
+      size_t _words;
+      std::vector<unsigned int> _last_letters;
+      std::vector<uint64_t> _visited;
+    };
+
+    /**
+       The cached prefixes, most recently used first. These point at the keys
+       of `_visited_cache`, which stay put for as long as the entry does.
+    */
+    typedef std::list<const std::string *> CacheRecency_t;
+
+    /**
+       Everything the cache keeps for a single prefix.
+    */
+    struct CacheEntry {
+      CacheEntry(const size_t board_size) : states(board_size), bytes(0) {}
+
+      GameStates states;
+      CacheRecency_t::iterator recency;
+      size_t bytes;
+    };
+
+    typedef boost::unordered_map<std::string, CacheEntry> GameStateCacheMap_t;
+
+    /**
+       \param prefix the prefix whose cache entry you want.
+       \param board_size the number of cells on the board being searched.
+       \return the cache entry for `prefix`, created empty if there wasn't one,
+       and marked as the most recently used.
+    */
+    CacheEntry & entry(const std::string & prefix, const size_t board_size);
+
+    /**
+       \param entry a cache entry which has had all of its states added.
+
+       Trims `entry` down to size and keeps track of the memory it costs.
+    */
+    void filled(CacheEntry & entry);
+
+    /**
+       Drops least recently used prefixes until the cache is within budget.
+    */
+    void enforce_budget();
+
+    /**
+       \param board_index the cell whose letter changed.
+       \param previous the letter that cell used to hold.
+       \param letter the letter it holds now.
+
+       Drops whatever in the cache a change of letter has made wrong.
+    */
+    void invalidate(const unsigned int board_index, 
+                    const char previous, 
+                    const char letter);
+
+    /**
+       A cache of all the words we've seen and all the end GameStates for 
+       those words; an association of words with the valid GameStates for said
+       word. 
+
+       If the associated states are empty, then that word can not be created on
+       the board.
+    */
+    GameStateCacheMap_t _visited_cache;
+    CacheRecency_t _recency;
+    CacheStats _stats;
+    size_t _budget;
+    bool _timing;
+
+    /**
+       Room for `might_reach()` to work in, kept here so each thread has its 
+       own and it needn't be allocated for every word.
+    */
+    Bitboard _frontier;
+    Bitboard _scratch;
+  };
+
+  /**
+     \param word a string representing the word you want to know about.
+     \param cache the cache to use, and populate, in place of the board's own.
+     \return true if `word` exists (i.e., is playable) in the boggle board,
+     false otherwise.
+
+     Behaves exactly like `exists(word)`, except that the board itself isn't
+     modified, so any number of threads can call this at once as long as each
+     has its own `cache`.
+  */
+  bool exists(const std::string & word, Cache & cache) const;
+
+  /**
+     \param bytes roughly how much memory the cache behind `exists(word)` may
+     hold, or 0 for no limit. See `Cache::set_budget()`.
+  */
+  void set_cache_budget(const size_t bytes) { _cache.set_budget(bytes); }
+
+  /**
+     \return the counters for the cache behind `exists(word)`.
+  */
+  const CacheStats & cache_stats() const { return _cache.stats(); }
+
+  /**
+     \param timing whether to time calls to `exists(word)`. See 
+     `Cache::set_timing()`.
+  */
+  void set_cache_timing(const bool timing) { _cache.set_timing(timing); }
+
+  /**
+     \param dictionary a trie holding every word you want to look for.
+     \return every word in `dictionary` that is playable on the board, in the
+     order the words were inserted into `dictionary`.
+
+     Rather than searching the board once per word, this does a single depth
+     first search from each cell, following the trie alongside the path and
+     abandoning any path whose prefix isn't in `dictionary`. Unlike `exists()`,
+     it doesn't touch the cache.
+  */
+  std::vector<std::string> solve(const Trie & dictionary) const;
+
 
   private:
 
+  /**
+     The board is stored as square tiles of `tile_length` x `tile_length` 
+     cells, one tile after another, so a cell's neighbors are nearly always a
+     few bytes away rather than a whole row away. 8 x 8 tiles also mean a tile
+     fits exactly in a single 64 bit word of a visited bitset.
+  */
+  static const unsigned int tile_length = 8;
+
   /**
      \param point the point you wish to convert to an index.
-     \param board_length the length or width of one of your board's sides.
      \returns int the index location of `point` on the internal representation 
      of the board.
 
-     Converts a Point into a board_index, where we assume the board is a single
-     dimension vector of length `board_length * board_length`
+     Converts a Point into a board_index in the tiled layout.
   */
-  static int board_index(const Point & point, const size_t board_length)
+  unsigned int board_index(const Point & point) const
   {
-    return point.x() + (point.y() * board_length);
+    const unsigned int tile = 
+        (point.y() / tile_length) * _tiles_across + point.x() / tile_length;
+    return tile * tile_length * tile_length + 
+        (point.y() % tile_length) * tile_length + point.x() % tile_length;
   }
 
   /**
      \param board_index the internal board representation index you wish to
      convert to an point.
-     \param board_length the length or width of one of your board's sides.
      \returns int the `point` equivalent of the internal board representation's
      index.
+
+     Indices in the padding past the right or bottom edge of the board give 
+     points off the board.
   */
-  static Point point(const unsigned int board_index, const size_t board_length)
+  Point point(const unsigned int board_index) const
   {
-    return Point((board_index%(board_length)), (board_index/(board_length)));
+    const unsigned int tile = board_index / (tile_length * tile_length);
+    const unsigned int cell = board_index % (tile_length * tile_length);
+    return Point(
+        (tile % _tiles_across) * tile_length + cell % tile_length,
+        (tile / _tiles_across) * tile_length + cell / tile_length);
   }
 
   /**
-     A class to encapsulate the state of the game for any given word.
+     \param board_index an index into `_board`.
+     \return true if `board_index` is a cell on the board, rather than 
+     padding at the edge of a tile.
   */
-  class GameState {
-    public:
-    GameState(const size_t board_length);
-    GameState(const GameState & state, const Point & point);
+  bool on_board(const unsigned int board_index) const
+  {
+    const Point cell = point(board_index);
+    return cell.x() < (int)_width && cell.y() < (int)_height;
+  }
 
-    void visit(const Point & point);
+  /**
+     \param board_stream the stream to read rows from.
 
-    bool visited(const unsigned int index) const { 
-      return _previously_visited[index];
-    }
+     Does the work of the stream constructor.
+  */
+  void load(std::istream & board_stream);
 
-    const std::vector<bool> & visited() const { return _previously_visited; }
+  /**
+     \param board_string newline separated rows of letters.
 
-    const Point & last_letter() const { return _last_char; }
+     Does the work of the string constructor, reading the rows where they are.
+  */
+  void load(const std::string & board_string);
 
-    private:
-    const size_t _board_length;
-    Point _last_char;
-    std::vector<bool> _previously_visited;
-  };
+  /**
+     \param begin the start of a row, without its newline.
+     \param end the end of the row.
+     \param remaining how many bytes there are to read, from the first row
+     on, if that's known, or -1 if not.
+     \param blank_lines how many blank lines have been seen since the last row.
+
+     Adds a row to the bottom of the board, making room for the whole board
+     when it's the first.
+  */
+  void add_row(const char * begin,
+               const char * end,
+               const std::streamoff remaining,
+               size_t & blank_lines);
+
+  /**
+     Builds `_neighbor_offsets`, `_neighbors`, `_letter_cells`, `_letters` and
+     `_bigrams` from `_board`.
+  */
+  void index_board();
+
+  /**
+     \param word the word you want to know about.
+     \return false if `word` certainly isn't on the board, true if it might be.
+
+     A handful of cheap checks which rule out most words without going near 
+     the cache: every letter must be on the board, the board must have as many
+     of each letter as the word needs, and every pair of consecutive letters
+     must be next to one another somewhere on the board.
+  */
+  bool might_exist(const std::string & word) const;
+
+  /**
+     Boards with at least this many cells get a bitboard for each letter, and
+     have words checked by `might_reach()` before they're searched for.
+  */
+  static const size_t frontier_cells = 64 * 64;
+
+  /**
+     \param word the word you want to know about.
+     \param cache the cache whose bitboards to work in.
+     \return false if `word` certainly isn't on the board, true if it might be.
+
+     Follows every cell the word could possibly have reached, letter by 
+     letter, all at once as a bitboard, rather than one path at a time. A path
+     is allowed to go back over its own cells, so this can't say a word is 
+     there, but it rules out most of the words that aren't in a few shifts per
+     64 cells for each letter, where the exact search could have thousands of 
+     paths to follow.
+  */
+  bool might_reach(const std::string & word, Cache & cache) const;
+
+  /**
+     \param board_index the cell whose neighbors you want.
+     \return iterators to the first and one past the last of the cells 
+     adjacent to `board_index`.
+  */
+  typedef std::vector<unsigned int>::const_iterator NeighborIterator_t;
+
+  NeighborIterator_t neighbors_begin(const unsigned int board_index) const
+  {
+    return _neighbors.begin() + _neighbor_offsets[board_index];
+  }
+
+  NeighborIterator_t neighbors_end(const unsigned int board_index) const
+  {
+    return _neighbors.begin() + _neighbor_offsets[board_index + 1];
+  }
+
+  /**
+     A (word index, word) pair found by `solve()`.
+  */
+  typedef std::pair<uint32_t, std::string> FoundWord_t;
 
-  typedef boost::unordered_map<
-    std::string, std::list<GameState> > GameStateCacheMap_t;
+  /**
+     \param dictionary the trie we're walking alongside the board.
+     \param node the trie node for the path taken so far, including the letter
+     at `board_index`.
+     \param board_index the cell the path currently ends on.
+     \param path the letters of the path taken so far.
+     \param visited which cells the path has already used.
+     \param emitted which words, by index, have already been found.
+     \param through if this is a cell on the board, only words whose path 
+     goes through it are found.
+     \param found where to put the words we find.
+
+     The recursive half of `solve()`.
+  */
+  void solve(const Trie & dictionary,
+             const uint32_t node,
+             const unsigned int board_index,
+             std::string & path,
+             std::vector<bool> & visited,
+             std::vector<bool> & emitted,
+             const size_t through,
+             std::vector<FoundWord_t> & found) const;
+
+  /**
+     \param first the first letter of the pair.
+     \param second the second letter of the pair.
+     \param adjacent true if there's now one more place `first` is next to 
+     `second`, false if there's one fewer.
+
+     Keeps `_bigrams` up to date as letters change.
+  */
+  void count_bigram(const unsigned char first, 
+                    const unsigned char second, 
+                    const bool adjacent);
+
+  /**
+     \param word the word you want to know about.
+     \param cache the cache to use.
+     \return true if `word` is playable on the board.
+
+     Does the actual work of `exists()`, leaving the cache however big it ends
+     up.
+  */
+  bool search(const std::string & word, Cache & cache) const;
 
   /**
      \param word the word you wish to look for in the cache.
+     \param cache the cache to look in.
      \return an iterator pointing to a position in the cache representing the 
      largest substring of the `word` parameter.
 
      If no substrings are found, the cache is primed with the first letter of 
      the `word` parameter, and an iterator to primed key-value pair is returned.
   */
-  GameStateCacheMap_t::iterator 
-  find_sub_word_gamestate(const std::string & word) const;
+  Cache::GameStateCacheMap_t::iterator 
+  find_sub_word_gamestate(const std::string & word, Cache & cache) const;
 
   /**
-     A cache of all the words we've seen and all the end GameStates for those 
-     words; an association of words with a list of valid GameStates for said
-     word. 
-
-     If the associated list is empty, then that word can not be created on 
-     `this` board.
+     The cache used by `exists(word)`.
   */
-  mutable GameStateCacheMap_t _visited_cache;
+  mutable Cache _cache;
 
+  /**
+     The letters of the board in tiled order. Cells of the right and bottom 
+     most tiles which are off the edge of the board hold '\0'.
+  */
   std::string _board;
-  size_t _length;
-  std::set<char> _letters;
+  size_t _width;
+  size_t _height;
+  size_t _tiles_across;
+
+  /**
+     Which letters, as unsigned chars, appear anywhere on the board; one bit 
+     each.
+  */
+  uint64_t _letters[4];
+
+  /**
+     Which pairs of letters appear next to one another somewhere on the board;
+     bit `(a << 8) | b` is set if some cell holding `a` has a neighbor holding 
+     `b`.
+  */
+  std::vector<uint64_t> _bigrams;
+
+  /**
+     How many times each pair of letters in `_bigrams` is adjacent. Only built
+     the first time a letter is changed.
+  */
+  std::vector<unsigned int> _bigram_counts;
+
+  /**
+     Where each letter, as an unsigned char, is on the board; empty for 
+     letters that aren't, and for boards smaller than `frontier_cells`.
+  */
+  std::vector<Bitboard> _letter_bitboards;
+
+  /**
+     The cells adjacent to each cell, all in one array. The neighbors of cell
+     `i` are `_neighbors[_neighbor_offsets[i]]` up to, but not including,
+     `_neighbors[_neighbor_offsets[i+1]]`.
+  */
+  std::vector<unsigned int> _neighbor_offsets;
+  std::vector<unsigned int> _neighbors;
+
+  /**
+     For each letter, as an unsigned char, the cells it appears in.
+  */
+  std::vector<std::vector<unsigned int> > _letter_cells;
 };
 
 
@@ -156,3 +655,5 @@ operator<< (std::ostream& stream, const boggle::Board & board )
 }
 
 }
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef BOGGLE_CLOCK_H
+#define BOGGLE_CLOCK_H
+
+// STL
+#include <time.h>
+
+namespace boggle {
+
+/**
+   \return the time in seconds since some fixed point in the past, for timing
+   things with.
+*/
+inline double seconds()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+}
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef BOGGLE_MAPPED_FILE_H
+#define BOGGLE_MAPPED_FILE_H
+
+// STL
+#include <string>
+
+// boost
+#include <boost/noncopyable.hpp>
+#include <boost/utility/string_view.hpp>
+
+namespace boggle {
+
+/**
+   A read only view of a whole file, memory mapped rather than read, so that
+   nothing gets copied out of the page cache until somebody actually looks at
+   it.
+*/
+class MappedFile : boost::noncopyable {
+
+  public:
+
+  /**
+     \param filename the path of the file to map.
+
+     Throws a std::runtime_error if the file can't be opened or mapped.
+  */
+  MappedFile(const std::string & filename);
+
+  ~MappedFile();
+
+  /**
+     \return a pointer to the first byte of the file.
+  */
+  const char * data() const { return _data; }
+
+  /**
+     \return the size of the file in bytes.
+  */
+  size_t size() const { return _size; }
+
+  private:
+
+  const char * _data;
+  size_t _size;
+};
+
+
+/**
+   Splits a mapped dictionary file into its words, one per line, handing each
+   back as a view straight into the mapped file.
+
+   Trailing whitespace, including the carriage return of a CRLF line ending,
+   is stripped and blank lines are skipped.
+*/
+class WordReader {
+
+  public:
+
+  /**
+     \param file the file to read words from. It must outlive the reader, and
+     any views the reader hands out.
+  */
+  WordReader(const MappedFile & file)
+      : _position(file.data()), _end(file.data() + file.size()) {}
+
+  /**
+     \param word set to the next word in the file.
+     \return true if there was another word, false at the end of the file.
+  */
+  bool next(boost::string_view & word);
+
+  private:
+
+  const char * _position;
+  const char * _end;
+};
+
+}
+
+#endif
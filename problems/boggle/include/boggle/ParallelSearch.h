@@ -0,0 +1,66 @@
+#ifndef BOGGLE_PARALLEL_SEARCH_H
+#define BOGGLE_PARALLEL_SEARCH_H
+
+// Project
+#include <boggle/Board.h>
+#include <boggle/Trie.h>
+
+// STL
+#include <string>
+#include <vector>
+
+namespace boggle {
+
+/**
+   \param board the board to play the words on.
+   \param words the dictionary, ideally sorted so that words sharing a prefix
+   sit next to one another.
+   \param threads how many worker threads to use.
+   \param cache_budget roughly how many bytes each worker's cache may hold, or 0
+   for no limit.
+   \param stats if not NULL, the counters of every worker's cache, summed.
+   \param timing whether to time every word for `CacheStats::latency`.
+   \return a vector the same size as `words` where element `i` is non-zero if
+   `words[i]` is playable on `board`.
+
+   Checks every word in `words` with `Board::exists()`, spread over `threads`
+   threads.
+
+   The dictionary is cut into small runs of neighboring words, so that each run
+   shares prefixes and gets good use out of a cache, and each worker is handed
+   an equal, contiguous block of those runs along with a cache of its own. A 
+   worker which finishes its block early steals runs off the far end of 
+   whichever other worker has the most left, so a block full of expensive
+   prefixes doesn't hold everyone up. `board` is only ever read from.
+*/
+std::vector<char> exists(const Board & board,
+                         const std::vector<std::string> & words,
+                         const unsigned int threads,
+                         const size_t cache_budget = 0,
+                         Board::CacheStats * stats = NULL,
+                         const bool timing = false);
+
+/**
+   \param boards the text of each board, as you'd give it to Board's 
+   constructor.
+   \param dictionary the words to look for on every board.
+   \param threads how many worker threads to use.
+   \param errors if not NULL, resized to match `boards`, with element `i` set
+   to why board `i` couldn't be read, or left empty if it could.
+   \return a vector the same size as `boards` where element `i` is every word
+   in `dictionary` playable on board `i`, as `Board::solve()` returns them.
+
+   Solves every board against the one dictionary, spread over `threads` 
+   threads. Workers take the next unsolved board as soon as they finish one, so
+   a few big boards don't hold everyone up. `dictionary` is only ever read 
+   from. A board which can't be read comes back with no words.
+*/
+std::vector<std::vector<std::string> > 
+solve(const std::vector<std::string> & boards,
+      const Trie & dictionary,
+      const unsigned int threads,
+      std::vector<std::string> * errors = NULL);
+
+}
+
+#endif
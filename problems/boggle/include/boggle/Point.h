@@ -1,3 +1,6 @@
+#ifndef BOGGLE_POINT_H
+#define BOGGLE_POINT_H
+
 // STL
 #include <fstream>
 #include <stdlib.h>
@@ -60,3 +63,5 @@ operator<< (std::ostream& stream, const boggle::Point & point )
 }
 
 }
+
+#endif
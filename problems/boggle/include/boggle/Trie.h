@@ -0,0 +1,148 @@
+#ifndef BOGGLE_TRIE_H
+#define BOGGLE_TRIE_H
+
+// Project
+#include <boggle/MappedFile.h>
+
+// STL
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// boost
+#include <boost/noncopyable.hpp>
+#include <boost/utility/string_view.hpp>
+
+namespace boggle {
+
+/**
+   A prefix tree over a dictionary of words.
+
+   Nodes are kept in a single flat vector in first-child/next-sibling form, so
+   walking the trie never allocates and the whole structure is a handful of
+   contiguous integers.
+
+   Because nodes only refer to one another by index, that array can be written
+   to disk with `write()` as is and later used straight out of a memory mapped
+   file, without being parsed or copied.
+*/
+class Trie : boost::noncopyable {
+
+  public:
+
+  /**
+     Value returned by `child()` and `word_index()` when there's no such node
+     or no word ends at the given node.
+  */
+  static const uint32_t npos = 0xffffffff;
+
+  /**
+     Constructs an empty trie containing only the root node.
+  */
+  Trie();
+
+  /**
+     \param index a file previously written by `write()`.
+     \param verify_checksum whether to check every node against the checksum
+     stored in the index as well.
+
+     Constructs a trie which uses the nodes in `index` in place, rather than
+     copying them. Every node's links are checked to point inside the index,
+     to children after it and to siblings before it, which means one pass over
+     it. `index` must outlive the trie, and nothing can be inserted into it.
+
+     Throws a std::runtime_error if `index` isn't a valid index for this 
+     version of the format, has a link out of range or out of order, or fails
+     its checksum.
+  */
+  Trie(const MappedFile & index, const bool verify_checksum = false);
+
+  /**
+     \param out the stream to write the index to, opened in binary mode.
+
+     Writes the trie out in a form `Trie(const MappedFile &)` can load: a small
+     header (a magic number, format version, byte order mark, node and word
+     counts, the longest word's length and a CRC-32 of the nodes) followed by
+     the nodes themselves.
+  */
+  void write(std::ostream & out) const;
+
+  /**
+     \param word the word to add to the trie.
+
+     Each distinct word is assigned an index in the order it was first
+     inserted. Empty words and repeated words are ignored.
+  */
+  void insert(const boost::string_view & word);
+
+  /**
+     \return the node index of the root of the trie, i.e., the empty prefix.
+  */
+  uint32_t root() const { return 0; }
+
+  /**
+     \param node the node whose child you want.
+     \param letter the letter on the edge leading to the child.
+     \return the index of the child of `node` reached by `letter`, or `npos`
+     if no word in the trie continues that way.
+  */
+  uint32_t child(const uint32_t node, const char letter) const;
+
+  /**
+     \param node a node in the trie.
+     \return the insertion index of the word ending at `node`, or `npos` if the
+     path to `node` is only a prefix.
+  */
+  uint32_t word_index(const uint32_t node) const
+  {
+    return _nodes[node].word_index;
+  }
+
+  /**
+     \param word the word to look up.
+     \return the insertion index of `word`, or `npos` if it isn't in the trie.
+  */
+  uint32_t find(const boost::string_view & word) const;
+
+  /**
+     \return the number of distinct words in the trie.
+  */
+  size_t size() const { return _word_count; }
+
+  /**
+     \return the length of the longest word in the trie.
+  */
+  size_t max_length() const { return _max_length; }
+
+  private:
+
+  /**
+     A single node, laid out exactly as it is in an index file.
+  */
+  struct Node {
+    uint32_t first_child;
+    uint32_t next_sibling;
+    uint32_t word_index;
+    char letter;
+    char padding[3];
+  };
+
+  /**
+     The nodes we've built ourselves, if we weren't loaded from an index.
+  */
+  std::vector<Node> _storage;
+
+  /**
+     The nodes, wherever they live.
+  */
+  const Node * _nodes;
+  size_t _node_count;
+  size_t _word_count;
+  size_t _max_length;
+  bool _read_only;
+};
+
+}
+
+#endif
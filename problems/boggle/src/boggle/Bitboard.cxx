@@ -0,0 +1,154 @@
+// Corresponding
+#include <boggle/Bitboard.h>
+
+// STL
+#include <algorithm>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+boggle::Bitboard::Bitboard()
+    : _width(0), _height(0), _stride(1), _first_row(1), _last_row(0)
+{
+}
+
+boggle::Bitboard::Bitboard(const size_t width, const size_t height)
+    : _width(width),
+      _height(height),
+      _stride((width + 63) / 64 + 1),
+      _first_row(1),
+      _last_row(0),
+      // One more word in front, so that the word before the first row's
+      // padding can be read too.
+      _bits((height + 2) * _stride + 1, 0)
+{
+}
+
+void
+boggle::Bitboard::set(const Point & point, const bool value)
+{
+  uint64_t & word = _bits[row(point.y()) + point.x() / 64];
+  const uint64_t bit = uint64_t(1) << (point.x() % 64);
+  if(!value) {
+    word &= ~bit;
+    return;
+  }
+
+  word |= bit;
+  if(_first_row > _last_row) {
+    _first_row = _last_row = point.y();
+  }
+  else {
+    _first_row = min<size_t>(_first_row, point.y());
+    _last_row = max<size_t>(_last_row, point.y());
+  }
+}
+
+bool
+boggle::Bitboard::expand(const Bitboard & from,
+                         const Bitboard & mask,
+                         Bitboard & scratch)
+{
+  if(_width != from._width || _height != from._height)
+    *this = Bitboard(from._width, from._height);
+  if(scratch._width != from._width || scratch._height != from._height)
+    scratch = Bitboard(from._width, from._height);
+
+  // Only the rows next to the ones `from` has cells in can end up with any.
+  size_t first = 1, last = 0;
+  if(from._first_row <= from._last_row) {
+    first = from._first_row ? from._first_row - 1 : 0;
+    last = min(from._last_row + 1, _height - 1);
+  }
+
+  // Get rid of whatever was left over from before, outside of those rows.
+  const size_t row_words = _stride - 1;
+  for(size_t y = _first_row; y <= _last_row; ++y) {
+    if(y < first || y > last)
+      fill(&_bits[row(y)], &_bits[row(y)] + row_words, 0);
+  }
+  _first_row = 1;
+  _last_row = 0;
+
+  if(first > last)
+    return false;
+
+  // First, everything above, below and in line with a cell, a whole row at a
+  // time, from the padding before the first row to the padding after the
+  // last.
+  const uint64_t * source = &from._bits[0];
+  uint64_t * vertical = &scratch._bits[0];
+  size_t word = row(first) - 1;
+  const size_t end = row(last + 1);
+
+#ifdef __AVX2__
+  for(; word + 4 <= end; word += 4)
+  {
+    const __m256i above = _mm256_loadu_si256(
+        (const __m256i *)(source + word - _stride));
+    const __m256i here = _mm256_loadu_si256((const __m256i *)(source + word));
+    const __m256i below = _mm256_loadu_si256(
+        (const __m256i *)(source + word + _stride));
+    _mm256_storeu_si256((__m256i *)(vertical + word),
+                        _mm256_or_si256(_mm256_or_si256(above, here), below));
+  }
+#endif
+  for(; word < end; ++word)
+    vertical[word] = source[word - _stride] | source[word] |
+        source[word + _stride];
+
+  // Then everything to either side of those, which are never carried past
+  // the ends of a row thanks to the padding, and only the cells we're allowed
+  // onto.
+  const uint64_t * allowed = &mask._bits[0];
+  for(size_t y = first; y <= last; ++y)
+  {
+    uint64_t any = 0;
+    word = row(y);
+    const size_t row_end = word + row_words;
+
+#ifdef __AVX2__
+    __m256i any_vector = _mm256_setzero_si256();
+    for(; word + 4 <= row_end; word += 4)
+    {
+      const __m256i left = _mm256_loadu_si256(
+          (const __m256i *)(vertical + word - 1));
+      const __m256i here = _mm256_loadu_si256(
+          (const __m256i *)(vertical + word));
+      const __m256i right = _mm256_loadu_si256(
+          (const __m256i *)(vertical + word + 1));
+      const __m256i spread = _mm256_or_si256(
+          _mm256_or_si256(here, _mm256_slli_epi64(here, 1)),
+          _mm256_or_si256(
+              _mm256_or_si256(_mm256_srli_epi64(here, 1),
+                              _mm256_srli_epi64(left, 63)),
+              _mm256_slli_epi64(right, 63)));
+      const __m256i next = _mm256_and_si256(
+          spread,
+          _mm256_loadu_si256((const __m256i *)(allowed + word)));
+      _mm256_storeu_si256((__m256i *)(&_bits[word]), next);
+      any_vector = _mm256_or_si256(any_vector, next);
+    }
+    any = !_mm256_testz_si256(any_vector, any_vector);
+#endif
+    for(; word < row_end; ++word)
+    {
+      const uint64_t here = vertical[word];
+      const uint64_t spread = here | (here << 1) | (here >> 1) |
+          (vertical[word - 1] >> 63) | (vertical[word + 1] << 63);
+      _bits[word] = spread & allowed[word];
+      any |= _bits[word];
+    }
+
+    if(any) {
+      if(_first_row > _last_row)
+        _first_row = y;
+      _last_row = y;
+    }
+  }
+
+  return _first_row <= _last_row;
+}
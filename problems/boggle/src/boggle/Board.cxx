@@ -2,66 +2,247 @@
 #include <boggle/Board.h>
 
 // STL
-#include <math.h> 
+#include <algorithm>
+#include <ctype.h>
+#include <limits.h>
 #include <sstream>
 #include <stdexcept>
+#include <string.h>
+#include <time.h>
 #include <vector>
 
 // boost
-#include <boost/algorithm/string.hpp>
 #include <boost/foreach.hpp>
 #include <boost/unordered_map.hpp>
 
 using namespace std;
 
 boggle::Board::Board(const string & board_string) 
-    : _board(board_string)
 {
-  boost::algorithm::trim(_board);
+  load(board_string);
+}
 
-  vector<string> rows;
-  boost::split(rows, _board, boost::is_any_of("\n"));
+boggle::Board::Board(istream & board_stream) 
+{
+  load(board_stream);
+}
 
+void
+boggle::Board::load(istream & board_stream)
+{
   _board.clear();
+  _width = _height = _tiles_across = 0;
+
+  // If we can tell how much is left to read, we can make room for the whole
+  // board up front rather than growing into it.
+  streamoff remaining = -1;
+  const streampos start = board_stream.tellg();
+  if(start != streampos(-1) && board_stream.seekg(0, ios::end)) {
+    remaining = board_stream.tellg() - start;
+    board_stream.seekg(start);
+  }
+  board_stream.clear();
 
-  // Make sure each row is the same length.
-  BOOST_FOREACH(const string & row, rows)
+  size_t blank_lines = 0;
+  string row;
+  while(getline(board_stream, row))
   {
-    if(row.size() != rows.back().size()) {
-      throw runtime_error("You have inconsistent row lengths.");
+    add_row(row.data(), row.data() + row.size(), remaining, blank_lines);
+  }
+
+  index_board();
+}
+
+void
+boggle::Board::load(const string & board_string)
+{
+  _board.clear();
+  _width = _height = _tiles_across = 0;
+
+  size_t blank_lines = 0;
+  const char * row = board_string.data();
+  const char * const end = row + board_string.size();
+  while(row != end)
+  {
+    const char * const newline = 
+        static_cast<const char *>(memchr(row, '\n', end - row));
+    const char * const row_end = newline ? newline : end;
+    add_row(row, row_end, end - row, blank_lines);
+    row = newline ? newline + 1 : end;
+  }
+
+  index_board();
+}
+
+void
+boggle::Board::add_row(const char * begin,
+                       const char * end,
+                       const streamoff remaining,
+                       size_t & blank_lines)
+{
+  while(end != begin && isspace(static_cast<unsigned char>(end[-1])))
+    --end;
+  if(end == begin) {
+    ++blank_lines;
+    return;
+  }
+
+  // Blank lines are fine before and after the board, but not in it.
+  if(blank_lines && _height) {
+    throw runtime_error("You have inconsistent row lengths.");
+  }
+  blank_lines = 0;
+
+  const size_t length = end - begin;
+  const unsigned int tile_cells = tile_length * tile_length;
+  if(_height == 0) {
+    _width = length;
+    _tiles_across = (_width + tile_length - 1) / tile_length;
+    if(remaining > 0) {
+      const size_t rows = remaining / (_width + 1) + 1;
+      _board.reserve(
+          ((rows + tile_length - 1) / tile_length) * _tiles_across * 
+          tile_cells);
     }
-    _board += row;
   }
 
-  // Make sure the number of columns matches the length of each row.
-  if(rows.size() != rows.back().size()) {
+  // Make sure each row is the same length.
+  if(length != _width) {
     throw runtime_error("You have inconsistent row lengths.");
   }
 
-  _length = (size_t)(sqrt(_board.size())); // _board is a factor of 2
+  // Start a new band of tiles every `tile_length` rows.
+  if(_height % tile_length == 0) {
+    _board.append(_tiles_across * tile_cells, '\0');
+  }
 
-  _letters.insert(_board.begin(), _board.end());
+  for(unsigned int x = 0; x < _width; ++x) {
+    _board[board_index(Point(x, _height))] = begin[x];
+  }
+  ++_height;
+}
+
+void
+boggle::Board::index_board()
+{
+  _neighbor_offsets.assign(1, 0);
+  _neighbors.clear();
+  _neighbors.reserve(_board.size() * 8);
+  _letter_cells.assign(UCHAR_MAX + 1, vector<unsigned int>());
+  fill(_letters, _letters + 4, 0);
+  _bigrams.assign((UCHAR_MAX + 1) * (UCHAR_MAX + 1) / 64, 0);
+  _letter_bitboards.assign(UCHAR_MAX + 1, Bitboard());
+  const bool bitboards = width() * height() >= frontier_cells;
+
+  for(unsigned int board_index = 0; 
+      board_index < _board.size(); 
+      ++board_index)
+  {
+    const unsigned char letter = _board[board_index];
+
+    // Padding has no neighbors, and isn't anyone's neighbor.
+    if(!on_board(board_index)) {
+      _neighbor_offsets.push_back(_neighbors.size());
+      continue;
+    }
+
+    const Point here = point(board_index);
+    for(int y = here.y() - 1; y <= here.y() + 1; ++y) {
+      for(int x = here.x() - 1; x <= here.x() + 1; ++x) {
+        if(x < 0 || y < 0 || x >= (int)width() || y >= (int)height())
+          continue;
+        if(x == here.x() && y == here.y())
+          continue;
+        _neighbors.push_back(Board::board_index(Point(x, y)));
+
+        const unsigned int bigram = 
+            (letter << 8) | (unsigned char)_board[_neighbors.back()];
+        _bigrams[bigram / 64] |= uint64_t(1) << (bigram % 64);
+      }
+    }
+    _neighbor_offsets.push_back(_neighbors.size());
+
+    _letter_cells[letter].push_back(board_index);
+    _letters[letter / 64] |= uint64_t(1) << (letter % 64);
+
+    if(bitboards) {
+      if(_letter_bitboards[letter].width() == 0)
+        _letter_bitboards[letter] = Bitboard(width(), height());
+      _letter_bitboards[letter].set(here, true);
+    }
+  }
+}
+
+bool
+boggle::Board::might_exist(const string & word) const
+{
+  // Every letter has to be somewhere on the board.
+  BOOST_FOREACH(const unsigned char letter, word) {
+    if(!((_letters[letter / 64] >> (letter % 64)) & 1))
+      return false;
+  }
+
+  // Every step from one letter to the next has to be possible somewhere.
+  for(size_t i = 1; i < word.size(); ++i) {
+    const unsigned int bigram = 
+        ((unsigned char)word[i-1] << 8) | (unsigned char)word[i];
+    if(!((_bigrams[bigram / 64] >> (bigram % 64)) & 1))
+      return false;
+  }
+
+  // And the board needs at least as many of each letter as the word uses.
+  unsigned int needed[UCHAR_MAX + 1];
+  memset(needed, 0, sizeof(needed));
+  BOOST_FOREACH(const unsigned char letter, word) {
+    if(++needed[letter] > _letter_cells[letter].size())
+      return false;
+  }
+
+  return true;
+}
+
+bool
+boggle::Board::might_reach(const string & word, Cache & cache) const
+{
+  if(width() * height() < frontier_cells || word.size() < 2)
+    return true;
+
+  // Every letter is on the board, or `might_exist()` would have said so, so 
+  // each has its bitboard.
+  if(!cache._frontier.expand(_letter_bitboards[(unsigned char)word[0]],
+                             _letter_bitboards[(unsigned char)word[1]],
+                             cache._scratch))
+    return false;
+
+  for(size_t i = 2; i < word.size(); ++i) {
+    if(!cache._frontier.expand(cache._frontier,
+                               _letter_bitboards[(unsigned char)word[i]],
+                               cache._scratch))
+      return false;
+  }
+
+  return true;
 }
 
 const char & 
 boggle::Board::letter(const Point & point) const
 {
-  if(point.x() > (int)length()-1) {
+  if(point.x() > (int)width()-1) {
     ostringstream error;
     error << "`x` position is out of bounds. board is "
-          << length() << " wide and you requested the data at index `"
+          << width() << " wide and you requested the data at index `"
           << point.x() << "`.";
     throw std::out_of_range(error.str());
   }
-  if(point.y() > (int)length()-1) {
+  if(point.y() > (int)height()-1) {
     ostringstream error;
     error << "`y` position is out of bounds. board is "
-          << length() << " long and you requested the data at index `"
+          << height() << " long and you requested the data at index `"
           << point.y() << "`.";
     throw std::out_of_range(error.str());
   }
 
-  return _board[Board::board_index(point, length())];
+  return _board[Board::board_index(point)];
 }
 
 string
@@ -69,8 +250,8 @@ boggle::Board::to_string() const
 {
   ostringstream str;
 
-  for(unsigned int y = 0; y < length(); ++y) {
-    for(unsigned int x = 0; x < length(); ++x) {
+  for(unsigned int y = 0; y < height(); ++y) {
+    for(unsigned int x = 0; x < width(); ++x) {
       str << letter(Point(x, y)) << " ";
     }
     str << endl;
@@ -80,25 +261,200 @@ boggle::Board::to_string() const
   return str.str();
 }
 
+void
+boggle::Board::set_letter(const Point & point, const char letter)
+{
+  const char previous = this->letter(point);
+  if(previous == letter)
+    return;
+
+  const unsigned int changed = board_index(point);
+
+  // Count every adjacent pair on the board, now that we need to know when
+  // the last of a pair goes away.
+  if(_bigram_counts.empty()) {
+    _bigram_counts.assign((UCHAR_MAX + 1) * (UCHAR_MAX + 1), 0);
+    for(unsigned int cell = 0; cell < _board.size(); ++cell) {
+      for(NeighborIterator_t neighbor = neighbors_begin(cell);
+          neighbor != neighbors_end(cell);
+          ++neighbor)
+      {
+        ++_bigram_counts[((unsigned char)_board[cell] << 8) | 
+                         (unsigned char)_board[*neighbor]];
+      }
+    }
+  }
+
+  for(NeighborIterator_t neighbor = neighbors_begin(changed);
+      neighbor != neighbors_end(changed);
+      ++neighbor)
+  {
+    count_bigram(previous, _board[*neighbor], false);
+    count_bigram(_board[*neighbor], previous, false);
+    count_bigram(letter, _board[*neighbor], true);
+    count_bigram(_board[*neighbor], letter, true);
+  }
+
+  vector<unsigned int> & previous_cells = 
+      _letter_cells[(unsigned char)previous];
+  previous_cells.erase(
+      lower_bound(previous_cells.begin(), previous_cells.end(), changed));
+  if(previous_cells.empty()) {
+    _letters[(unsigned char)previous / 64] &= 
+        ~(uint64_t(1) << ((unsigned char)previous % 64));
+  }
+
+  vector<unsigned int> & letter_cells = _letter_cells[(unsigned char)letter];
+  letter_cells.insert(
+      lower_bound(letter_cells.begin(), letter_cells.end(), changed), changed);
+  _letters[(unsigned char)letter / 64] |= 
+      uint64_t(1) << ((unsigned char)letter % 64);
+
+  if(width() * height() >= frontier_cells) {
+    _letter_bitboards[(unsigned char)previous].set(point, false);
+    if(_letter_bitboards[(unsigned char)letter].width() == 0) {
+      _letter_bitboards[(unsigned char)letter] = 
+          Bitboard(width(), height());
+    }
+    _letter_bitboards[(unsigned char)letter].set(point, true);
+  }
+
+  _board[changed] = letter;
+  _cache.invalidate(changed, previous, letter);
+}
+
+void
+boggle::Board::count_bigram(const unsigned char first, 
+                            const unsigned char second, 
+                            const bool adjacent)
+{
+  const unsigned int bigram = (first << 8) | second;
+  if(adjacent) {
+    ++_bigram_counts[bigram];
+    _bigrams[bigram / 64] |= uint64_t(1) << (bigram % 64);
+  }
+  else if(--_bigram_counts[bigram] == 0) {
+    _bigrams[bigram / 64] &= ~(uint64_t(1) << (bigram % 64));
+  }
+}
+
+void
+boggle::Board::resolve(const Trie & dictionary,
+                       const Point & changed,
+                       const char previous,
+                       vector<string> & found) const
+{
+  vector<FoundWord_t> words;
+
+  // Words which didn't use the old letter can't have lost their path. The 
+  // rest have to be checked again.
+  BOOST_FOREACH(const string & word, found) {
+    if(word.find(previous) == string::npos || exists(word))
+      words.push_back(make_pair(dictionary.find(word), word));
+  }
+
+  // Any new word has to pass through the changed cell, so it has to start 
+  // close enough to reach it.
+  vector<bool> visited(_board.size(), false);
+  vector<bool> emitted(dictionary.size(), false);
+  string path;
+  const int reach = max<int>(dictionary.max_length(), 1) - 1;
+  const unsigned int through = board_index(changed);
+
+  for(int y = max(changed.y() - reach, 0); 
+      y <= min(changed.y() + reach, (int)height() - 1); 
+      ++y) 
+  {
+    for(int x = max(changed.x() - reach, 0); 
+        x <= min(changed.x() + reach, (int)width() - 1); 
+        ++x) 
+    {
+      const unsigned int start = board_index(Point(x, y));
+      const uint32_t node = dictionary.child(dictionary.root(), _board[start]);
+      if(node == Trie::npos)
+        continue;
+
+      path.push_back(_board[start]);
+      visited[start] = true;
+      solve(dictionary, node, start, path, visited, emitted, through, words);
+      visited[start] = false;
+      path.clear();
+    }
+  }
+
+  // Put everything back in dictionary order, without the words found twice.
+  sort(words.begin(), words.end());
+  words.erase(unique(words.begin(), words.end()), words.end());
+
+  found.clear();
+  BOOST_FOREACH(const FoundWord_t & word, words) {
+    found.push_back(word.second);
+  }
+}
+
 bool
 boggle::Board::exists(const string & word) const
 {
+  return exists(word, _cache);
+}
+
+bool
+boggle::Board::exists(const string & word, Cache & cache) const
+{
+  if(!cache._timing) {
+    const bool found = search(word, cache);
+    cache.enforce_budget();
+    return found;
+  }
+
+  timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  const bool found = search(word, cache);
+  cache.enforce_budget();
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  const uint64_t nanoseconds = 
+      (end.tv_sec - start.tv_sec) * uint64_t(1000000000) + 
+      end.tv_nsec - start.tv_nsec;
+  size_t bucket = 0;
+  while(bucket + 1 < CacheStats::latency_buckets && 
+        (nanoseconds >> (bucket + 1)))
+  {
+    ++bucket;
+  }
+  ++cache._stats.latency[bucket];
+  cache._stats.nanoseconds += nanoseconds;
+
+  return found;
+}
+
+bool
+boggle::Board::search(const string & word, Cache & cache) const
+{
+  ++cache._stats.checked;
+
   // If this isn't a word, nope
   if(word.empty())
     return false;
 
-  // If the word contains letters that aren't on the board, nope.
-  BOOST_FOREACH(const char letter, word) {
-    if(!_letters.count(letter))
-      return false;
+  // If the word contains letters that aren't on the board, or more of them 
+  // than are on the board, or letters that are never next to one another, 
+  // nope.
+  //
+  // Or, on a big board, if there's no way to get from one letter to the next
+  // all the way through the word, even allowing cells to be reused, nope.
+  if(!might_exist(word) || !might_reach(word, cache)) {
+    ++cache._stats.filtered;
+    return false;
   }
 
   // Find a substring in the cache
-  GameStateCacheMap_t::iterator cache_itr(find_sub_word_gamestate(word));
+  Cache::GameStateCacheMap_t::iterator cache_itr(
+      find_sub_word_gamestate(word, cache));
 
   // If the found substring has no valid GameStates, then neither can any string 
   // containing it, so... nope.
-  if(cache_itr->second.empty())
+  if(cache_itr->second.states.empty())
     return false;
 
   // If the subword we've found is the same size as the word we're looking for,
@@ -115,97 +471,382 @@ boggle::Board::exists(const string & word) const
       substr_end_index <= word.size(); 
       ++substr_end_index)
   {
-    const string cached_subword = word.substr(0, substr_end_index-1);
+    const Cache::CacheEntry & cached_subword = 
+        cache.entry(word.substr(0, substr_end_index-1), _board.size());
     const string uncached_subword = word.substr(0, substr_end_index);
+    Cache::CacheEntry & uncached_entry = 
+        cache.entry(uncached_subword, _board.size());
+
+    const char next_letter = uncached_subword[uncached_subword.size()-1];
 
-    for(unsigned int board_index = 0;
-        board_index < _board.size();
-        ++board_index)
+    for(size_t state = 0; state < cached_subword.states.size(); ++state)
     {
-      // If this board letter isn't the one we need, then try again.
-      if(_board[board_index] != uncached_subword[uncached_subword.size()-1])
-        continue;
+      const unsigned int last_letter = 
+          cached_subword.states.last_letter(state);
 
-      BOOST_FOREACH(const GameState & state, _visited_cache[cached_subword])
+      // Only the cells next to the last letter can possibly continue the path.
+      for(NeighborIterator_t neighbor = neighbors_begin(last_letter);
+          neighbor != neighbors_end(last_letter);
+          ++neighbor)
       {
-        // If this board letter is already visited, then try again. 
-        if(state.visited(board_index))
+        // If this board letter isn't the one we need, then try again.
+        if(_board[*neighbor] != next_letter)
           continue;
 
-        const Point board_point = Board::point(board_index, length());
-
-        // If the found letter isn't adjacent to the last one, then try again.
-        if(!state.last_letter().adjacent(board_point))
+        // If this board letter is already visited, then try again. 
+        if(cached_subword.states.visited(state, *neighbor))
           continue;
 
-        // We found a valid position. Create a new state, same as the one we're
-        // looking at, with the current board position visited. Add it to this 
-        // substring's list in the cache, and move on.
-        _visited_cache[uncached_subword].push_back(
-            GameState(state, board_point));
+        // We found a valid position. Add a new state, same as the one we're
+        // looking at, with the current board position visited, to this 
+        // substring's entry in the cache, and move on.
+        uncached_entry.states.push_back(
+            cached_subword.states, state, *neighbor);
       }
     }
 
-    if(_visited_cache[uncached_subword].empty())
+    cache.filled(uncached_entry);
+
+    if(uncached_entry.states.empty())
       return false;
   }
 
-  return _visited_cache[word].size() > 0;
+  return true;
 
   // If you're gotten through this method without reading all the "nope"s and
   // "yup"s in the voice of Lana from the TV show Archer, go back and do it 
   // again.
 }
 
-boggle::Board::GameStateCacheMap_t::iterator
-boggle::Board::find_sub_word_gamestate(const string & word) const
+vector<string>
+boggle::Board::solve(const Trie & dictionary) const
+{
+  vector<FoundWord_t> found;
+  vector<bool> visited(_board.size(), false);
+  vector<bool> emitted(dictionary.size(), false);
+  string path;
+
+  for(unsigned int board_index = 0; 
+      board_index < _board.size(); 
+      ++board_index)
+  {
+    if(!on_board(board_index))
+      continue;
+
+    const uint32_t node = 
+        dictionary.child(dictionary.root(), _board[board_index]);
+    if(node == Trie::npos)
+      continue;
+
+    path.push_back(_board[board_index]);
+    visited[board_index] = true;
+    solve(dictionary, node, board_index, path, visited, emitted, 
+          _board.size(), found);
+    visited[board_index] = false;
+    path.clear();
+  }
+
+  // Put everything back in dictionary order.
+  sort(found.begin(), found.end());
+
+  vector<string> words;
+  words.reserve(found.size());
+  BOOST_FOREACH(const FoundWord_t & word, found) {
+    words.push_back(word.second);
+  }
+  return words;
+}
+
+void
+boggle::Board::solve(const Trie & dictionary,
+                     const uint32_t node,
+                     const unsigned int board_index,
+                     string & path,
+                     vector<bool> & visited,
+                     vector<bool> & emitted,
+                     const size_t through,
+                     vector<FoundWord_t> & found) const
+{
+  // The same word can be reached by more than one path, so only take it the
+  // first time.
+  const uint32_t word_index = dictionary.word_index(node);
+  if(word_index != Trie::npos && !emitted[word_index] &&
+     (through == _board.size() || visited[through])) 
+  {
+    emitted[word_index] = true;
+    found.push_back(make_pair(word_index, path));
+  }
+
+  for(NeighborIterator_t neighbor = neighbors_begin(board_index);
+      neighbor != neighbors_end(board_index);
+      ++neighbor)
+  {
+    const unsigned int next_index = *neighbor;
+    if(visited[next_index])
+      continue;
+
+    // If no word continues with this letter, don't bother going any further
+    // down this path.
+    const uint32_t next_node = dictionary.child(node, _board[next_index]);
+    if(next_node == Trie::npos)
+      continue;
+
+    path.push_back(_board[next_index]);
+    visited[next_index] = true;
+    solve(dictionary, next_node, next_index, path, visited, emitted, 
+          through, found);
+    visited[next_index] = false;
+    path.erase(path.size() - 1);
+  }
+}
+
+boggle::Board::Cache::GameStateCacheMap_t::iterator
+boggle::Board::find_sub_word_gamestate(const string & word, Cache & cache) const
 {
   // Look in the cache for sub words we've encountered already
   for(unsigned int i = 0; i < word.size(); ++i)
   {
-    GameStateCacheMap_t::iterator itr =
-        _visited_cache.find(word.substr(0, word.size()-i));
-    if(itr != _visited_cache.end()) 
+    Cache::GameStateCacheMap_t::iterator itr =
+        cache._visited_cache.find(word.substr(0, word.size()-i));
+    if(itr != cache._visited_cache.end()) {
+      const size_t length = word.size() - i;
+      if(cache._stats.hits_by_length.size() <= length)
+        cache._stats.hits_by_length.resize(length + 1, 0);
+      ++cache._stats.hits_by_length[length];
+      ++cache._stats.hits;
+      cache._recency.splice(
+          cache._recency.begin(), cache._recency, itr->second.recency);
       return itr;
+    }
   }
 
   // If we haven't encountered any portion of this word, prime the cache.
-  list<GameState> states;
-  for(unsigned int i = 0; i < _board.size(); ++i)
+  ++cache._stats.misses;
+  Cache::CacheEntry & entry = cache.entry(word.substr(0,1), _board.size());
+  BOOST_FOREACH(const unsigned int board_index, 
+                _letter_cells[(unsigned char)word[0]])
   {
-    if(_board[i] == word[0]) {
-      states.push_back(GameState(length()));
-      states.back().visit(Board::point(i, length()));
+    entry.states.push_back(board_index);
+  }
+  cache.filled(entry);
+
+  return cache._visited_cache.find(word.substr(0,1));
+}
+
+boggle::Board::CacheStats::CacheStats() 
+    : hits(0), 
+      misses(0), 
+      evictions(0), 
+      bytes(0),
+      checked(0),
+      filtered(0),
+      game_states(0),
+      entries(0),
+      peak_entries(0),
+      peak_bytes(0),
+      nanoseconds(0)
+{
+  fill(latency, latency + latency_buckets, 0);
+}
+
+boggle::Board::CacheStats &
+boggle::Board::CacheStats::operator+=(const CacheStats & other)
+{
+  hits += other.hits;
+  misses += other.misses;
+  evictions += other.evictions;
+  bytes += other.bytes;
+  checked += other.checked;
+  filtered += other.filtered;
+  game_states += other.game_states;
+  entries += other.entries;
+  peak_entries += other.peak_entries;
+  peak_bytes += other.peak_bytes;
+  nanoseconds += other.nanoseconds;
+
+  if(hits_by_length.size() < other.hits_by_length.size())
+    hits_by_length.resize(other.hits_by_length.size(), 0);
+  for(size_t length = 0; length < other.hits_by_length.size(); ++length) {
+    hits_by_length[length] += other.hits_by_length[length];
+  }
+
+  for(size_t bucket = 0; bucket < latency_buckets; ++bucket) {
+    latency[bucket] += other.latency[bucket];
+  }
+
+  return *this;
+}
+
+boggle::Board::Cache::Cache() : _budget(0), _timing(false)
+{}
+
+void
+boggle::Board::Cache::set_budget(const size_t bytes)
+{
+  _budget = bytes;
+  enforce_budget();
+}
+
+boggle::Board::Cache::CacheEntry &
+boggle::Board::Cache::entry(const string & prefix, const size_t board_size)
+{
+  GameStateCacheMap_t::iterator itr = _visited_cache.find(prefix);
+  if(itr != _visited_cache.end()) {
+    _recency.splice(_recency.begin(), _recency, itr->second.recency);
+    return itr->second;
+  }
+
+  itr = _visited_cache.insert(
+      make_pair(prefix, CacheEntry(board_size))).first;
+  _recency.push_front(&itr->first);
+  itr->second.recency = _recency.begin();
+
+  // The map node, its bucket, the key's characters and the recency list node.
+  itr->second.bytes = 
+      sizeof(GameStateCacheMap_t::value_type) + 2 * sizeof(void *) +
+      itr->first.capacity() + 3 * sizeof(void *);
+  _stats.bytes += itr->second.bytes;
+  _stats.peak_bytes = max(_stats.peak_bytes, _stats.bytes);
+  _stats.peak_entries = max(_stats.peak_entries, ++_stats.entries);
+
+  return itr->second;
+}
+
+void
+boggle::Board::Cache::filled(CacheEntry & entry)
+{
+  entry.states.shrink_to_fit();
+  entry.bytes += entry.states.bytes();
+  _stats.bytes += entry.states.bytes();
+  _stats.peak_bytes = max(_stats.peak_bytes, _stats.bytes);
+  _stats.game_states += entry.states.size();
+}
+
+void
+boggle::Board::Cache::clear()
+{
+  _visited_cache.clear();
+  _recency.clear();
+  _stats.bytes = 0;
+  _stats.entries = 0;
+}
+
+void
+boggle::Board::Cache::invalidate(const unsigned int board_index, 
+                                 const char previous, 
+                                 const char letter)
+{
+  GameStateCacheMap_t::iterator itr = _visited_cache.begin();
+  while(itr != _visited_cache.end())
+  {
+    CacheEntry & entry = itr->second;
+
+    // The new letter might give this prefix paths it didn't have before, so
+    // it'll have to be searched for again.
+    if(itr->first.find(letter) != string::npos) {
+      _stats.bytes -= entry.bytes;
+      _recency.erase(entry.recency);
+      itr = _visited_cache.erase(itr);
+      --_stats.entries;
+      continue;
+    }
+
+    // Any of this prefix's paths through the changed cell relied on the old
+    // letter being there, so they're gone. None of its other paths changed.
+    if(itr->first.find(previous) != string::npos) {
+      const size_t bytes = entry.states.bytes();
+      entry.states.remove_visiting(board_index);
+      entry.states.shrink_to_fit();
+      entry.bytes -= bytes - entry.states.bytes();
+      _stats.bytes -= bytes - entry.states.bytes();
     }
+
+    ++itr;
   }
+}
 
-  return _visited_cache.insert(make_pair(word.substr(0,1), states)).first;
+void
+boggle::Board::Cache::enforce_budget()
+{
+  if(_budget == 0)
+    return;
+
+  while(_stats.bytes > _budget && !_recency.empty())
+  {
+    GameStateCacheMap_t::iterator itr = _visited_cache.find(*_recency.back());
+    _stats.bytes -= itr->second.bytes;
+    _recency.pop_back();
+    _visited_cache.erase(itr);
+    --_stats.entries;
+    ++_stats.evictions;
+  }
 }
 
-boggle::Board::GameState::GameState(const size_t board_length) : 
-    _board_length(board_length),
-    _last_char(-1, -1),
-    _previously_visited(board_length * board_length, false) 
+boggle::Board::Cache::GameStates::GameStates(const size_t board_size) 
+    : _words((board_size + 63) / 64)
 {}
 
-boggle::Board::GameState:: GameState(
-    const GameState & state, const Point & point) 
-    : _board_length(state._board_length),
-      _last_char(state._last_char),
-      _previously_visited(state._previously_visited) 
+void
+boggle::Board::Cache::GameStates::push_back(const unsigned int board_index)
 {
-  visit(point);
+  _last_letters.push_back(board_index);
+  _visited.resize(_visited.size() + _words, 0);
+  _visited[_visited.size() - _words + board_index / 64] |= 
+      uint64_t(1) << (board_index % 64);
 }
 
-void 
-boggle::Board::GameState::visit(const Point & point) 
+void
+boggle::Board::Cache::GameStates::push_back(const GameStates & states,
+                                     const size_t state,
+                                     const unsigned int board_index)
 {
-  _last_char = point;
+  _last_letters.push_back(board_index);
+
+  // Boards of 64 cells or less, which is most of them, fit in a single word.
+  if(_words == 1) {
+    _visited.push_back(
+        states._visited[state] | (uint64_t(1) << board_index));
+    return;
+  }
 
-  const int index = Board::board_index(point, _board_length);
+  const vector<uint64_t>::const_iterator visited = 
+      states._visited.begin() + state * _words;
+  _visited.insert(_visited.end(), visited, visited + _words);
+  _visited[_visited.size() - _words + board_index / 64] |= 
+      uint64_t(1) << (board_index % 64);
+}
+
+void
+boggle::Board::Cache::GameStates::remove_visiting(
+    const unsigned int board_index)
+{
+  size_t kept = 0;
+  for(size_t state = 0; state < size(); ++state)
+  {
+    if(visited(state, board_index))
+      continue;
+
+    _last_letters[kept] = _last_letters[state];
+    copy(_visited.begin() + state * _words, 
+         _visited.begin() + (state + 1) * _words,
+         _visited.begin() + kept * _words);
+    ++kept;
+  }
+  _last_letters.resize(kept);
+  _visited.resize(kept * _words);
+}
 
-  if(index < 0 || index >= (int)_previously_visited.size())
-    throw out_of_range("Can't visit a point off the board");
+void
+boggle::Board::Cache::GameStates::shrink_to_fit()
+{
+  vector<unsigned int>(_last_letters).swap(_last_letters);
+  vector<uint64_t>(_visited).swap(_visited);
+}
 
-  _previously_visited[index] = true;
+size_t
+boggle::Board::Cache::GameStates::bytes() const
+{
+  return 
+      _last_letters.capacity() * sizeof(unsigned int) + 
+      _visited.capacity() * sizeof(uint64_t);
 }
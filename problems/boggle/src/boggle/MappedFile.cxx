@@ -0,0 +1,80 @@
+// Corresponding
+#include <boggle/MappedFile.h>
+
+// STL
+#include <stdexcept>
+#include <string.h>
+
+// POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+boggle::MappedFile::MappedFile(const string & filename) 
+    : _data(NULL), _size(0)
+{
+  const int descriptor = open(filename.c_str(), O_RDONLY);
+  if(descriptor < 0)
+    throw runtime_error("Can't open: " + filename);
+
+  struct stat status;
+  if(fstat(descriptor, &status) != 0) {
+    close(descriptor);
+    throw runtime_error("Can't stat: " + filename);
+  }
+  _size = status.st_size;
+
+  // There's nothing to map in an empty file, and mmap won't try.
+  if(_size == 0) {
+    close(descriptor);
+    return;
+  }
+
+  void * data = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+  close(descriptor);
+  if(data == MAP_FAILED)
+    throw runtime_error("Can't map: " + filename);
+
+  // We only ever read front to back, so let the kernel read ahead hard.
+  madvise(data, _size, MADV_SEQUENTIAL);
+
+  _data = static_cast<const char *>(data);
+}
+
+boggle::MappedFile::~MappedFile()
+{
+  if(_data)
+    munmap(const_cast<char *>(_data), _size);
+}
+
+bool
+boggle::WordReader::next(boost::string_view & word)
+{
+  while(_position < _end)
+  {
+    const char * line_end = static_cast<const char *>(
+        memchr(_position, '\n', _end - _position));
+    if(!line_end)
+      line_end = _end;
+
+    const char * word_end = line_end;
+    while(word_end > _position && 
+          (word_end[-1] == '\r' || word_end[-1] == ' ' || word_end[-1] == '\t'))
+    {
+      --word_end;
+    }
+
+    const char * word_begin = _position;
+    _position = line_end + (line_end < _end ? 1 : 0);
+
+    if(word_end != word_begin) {
+      word = boost::string_view(word_begin, word_end - word_begin);
+      return true;
+    }
+  }
+
+  return false;
+}
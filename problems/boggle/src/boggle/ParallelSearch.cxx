@@ -0,0 +1,237 @@
+// Corresponding
+#include <boggle/ParallelSearch.h>
+
+// STL
+#include <algorithm>
+#include <deque>
+#include <stdexcept>
+
+// boost
+#include <boost/bind/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+namespace {
+
+/**
+   How many neighboring words make up a single run of work.
+*/
+const size_t words_per_run = 256;
+
+/**
+   The runs of work a single worker has yet to do, identified by the index of
+   their first word. The owner takes runs off the front, thieves take them off
+   the back.
+*/
+struct WorkQueue {
+  boost::mutex mutex;
+  deque<size_t> runs;
+};
+
+/**
+   Everything the workers share.
+*/
+struct Search {
+  Search(const boggle::Board & the_board,
+         const vector<string> & the_words,
+         const size_t threads)
+      : board(the_board), 
+        words(the_words),
+        found(the_words.size(), 0),
+        stats(threads)
+  {
+    for(size_t i = 0; i < threads; ++i)
+      queues.push_back(new WorkQueue());
+  }
+
+  const boggle::Board & board;
+  const vector<string> & words;
+  vector<char> found;
+  boost::ptr_vector<WorkQueue> queues;
+  vector<boggle::Board::CacheStats> stats;
+};
+
+/**
+   \param search the search being worked on.
+   \param worker the index of the worker looking for work.
+   \param run where to put the index of the run's first word.
+   \return true if there was a run to be had, false if all the work is done.
+*/
+bool next_run(Search & search, const size_t worker, size_t & run)
+{
+  // Try our own work first.
+  {
+    WorkQueue & queue = search.queues[worker];
+    boost::lock_guard<boost::mutex> lock(queue.mutex);
+    if(!queue.runs.empty()) {
+      run = queue.runs.front();
+      queue.runs.pop_front();
+      return true;
+    }
+  }
+
+  // Otherwise steal from the back of whoever has the most left. Nothing is
+  // ever added to a queue, so once every queue is empty, we're done.
+  while(true)
+  {
+    size_t victim = worker;
+    size_t most = 0;
+    for(size_t i = 0; i < search.queues.size(); ++i) {
+      boost::lock_guard<boost::mutex> lock(search.queues[i].mutex);
+      if(search.queues[i].runs.size() > most) {
+        most = search.queues[i].runs.size();
+        victim = i;
+      }
+    }
+
+    if(most == 0)
+      return false;
+
+    WorkQueue & queue = search.queues[victim];
+    boost::lock_guard<boost::mutex> lock(queue.mutex);
+    if(!queue.runs.empty()) {
+      run = queue.runs.back();
+      queue.runs.pop_back();
+      return true;
+    }
+  }
+}
+
+/**
+   \param search the search being worked on.
+   \param worker the index of this worker.
+   \param cache_budget roughly how many bytes this worker's cache may hold.
+   \param timing whether to time each word.
+
+   The body of each worker thread.
+*/
+void work(Search & search, 
+          const size_t worker, 
+          const size_t cache_budget,
+          const bool timing)
+{
+  boggle::Board::Cache cache;
+  cache.set_budget(cache_budget);
+  cache.set_timing(timing);
+
+  size_t run;
+  while(next_run(search, worker, run))
+  {
+    const size_t end = min(run + words_per_run, search.words.size());
+    for(size_t i = run; i < end; ++i) {
+      search.found[i] = search.board.exists(search.words[i], cache);
+    }
+  }
+
+  search.stats[worker] = cache.stats();
+}
+
+/**
+   Everything the workers solving a batch of boards share.
+*/
+struct Batch {
+  Batch(const vector<string> & the_boards, const boggle::Trie & the_dictionary)
+      : boards(the_boards),
+        dictionary(the_dictionary),
+        next(0),
+        words(the_boards.size()),
+        errors(the_boards.size())
+  {}
+
+  const vector<string> & boards;
+  const boggle::Trie & dictionary;
+
+  boost::mutex mutex;
+  size_t next;
+
+  vector<vector<string> > words;
+  vector<string> errors;
+};
+
+/**
+   \param batch the batch being worked on.
+
+   The body of each worker thread solving a batch of boards.
+*/
+void solve_boards(Batch & batch)
+{
+  while(true)
+  {
+    size_t board;
+    {
+      boost::lock_guard<boost::mutex> lock(batch.mutex);
+      if(batch.next == batch.boards.size())
+        return;
+      board = batch.next++;
+    }
+
+    try {
+      batch.words[board] = 
+          boggle::Board(batch.boards[board]).solve(batch.dictionary);
+    }
+    catch(const exception & error) {
+      batch.errors[board] = error.what();
+    }
+  }
+}
+
+}
+
+vector<char>
+boggle::exists(const Board & board,
+               const vector<string> & words,
+               const unsigned int threads,
+               const size_t cache_budget,
+               Board::CacheStats * stats,
+               const bool timing)
+{
+  const size_t workers = max(threads, 1u);
+  Search search(board, words, workers);
+
+  // Deal out contiguous blocks of runs, so each worker starts off with its own
+  // stretch of the dictionary.
+  const size_t runs = (words.size() + words_per_run - 1) / words_per_run;
+  for(size_t run = 0; run < runs; ++run) {
+    search.queues[run * workers / runs].runs.push_back(run * words_per_run);
+  }
+
+  boost::thread_group group;
+  for(size_t worker = 0; worker < workers; ++worker) {
+    group.create_thread(
+        boost::bind(work, boost::ref(search), worker, cache_budget, timing));
+  }
+  group.join_all();
+
+  if(stats) {
+    *stats = Board::CacheStats();
+    for(size_t worker = 0; worker < workers; ++worker) {
+      *stats += search.stats[worker];
+    }
+  }
+
+  return search.found;
+}
+
+vector<vector<string> >
+boggle::solve(const vector<string> & boards,
+              const Trie & dictionary,
+              const unsigned int threads,
+              vector<string> * errors)
+{
+  Batch batch(boards, dictionary);
+
+  boost::thread_group group;
+  for(unsigned int worker = 0; worker < max(threads, 1u); ++worker) {
+    group.create_thread(boost::bind(solve_boards, boost::ref(batch)));
+  }
+  group.join_all();
+
+  if(errors)
+    errors->swap(batch.errors);
+
+  vector<vector<string> > words;
+  words.swap(batch.words);
+  return words;
+}
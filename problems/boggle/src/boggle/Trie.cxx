@@ -0,0 +1,212 @@
+// Corresponding
+#include <boggle/Trie.h>
+
+// STL
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+
+// boost
+#include <boost/crc.hpp>
+
+using namespace std;
+
+namespace {
+
+/**
+   The first thing in every index file.
+*/
+struct IndexHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t node_count;
+  uint64_t word_count;
+  uint32_t node_size;
+  uint32_t checksum;
+  uint32_t max_length;
+  uint32_t reserved;
+};
+
+const char index_magic[8] = { 'B', 'O', 'G', 'G', 'L', 'E', 'T', 'R' };
+
+/**
+   Bump this whenever the layout of the header or of a node changes.
+*/
+const uint32_t index_version = 2;
+
+/**
+   Written in the host's byte order, so an index from a machine of the other
+   endianness reads back as 0x04030201.
+*/
+const uint32_t index_byte_order = 0x01020304;
+
+uint32_t checksum(const void * data, const size_t size)
+{
+  boost::crc_32_type crc;
+  crc.process_bytes(data, size);
+  return crc.checksum();
+}
+
+}
+
+boggle::Trie::Trie() 
+    : _nodes(NULL), 
+      _node_count(0), 
+      _word_count(0), 
+      _max_length(0), 
+      _read_only(false)
+{
+  Node root = { npos, npos, npos, '\0', {} };
+  _storage.push_back(root);
+  _nodes = &_storage[0];
+  _node_count = _storage.size();
+}
+
+boggle::Trie::Trie(const MappedFile & index, const bool verify_checksum)
+    : _nodes(NULL), 
+      _node_count(0), 
+      _word_count(0), 
+      _max_length(0), 
+      _read_only(true)
+{
+  if(index.size() < sizeof(IndexHeader))
+    throw runtime_error("Dictionary index is too small to have a header.");
+
+  IndexHeader header;
+  memcpy(&header, index.data(), sizeof(header));
+
+  if(memcmp(header.magic, index_magic, sizeof(index_magic)) != 0)
+    throw runtime_error("File isn't a dictionary index.");
+  if(header.version != index_version)
+    throw runtime_error("Dictionary index is from a different version.");
+  if(header.byte_order != index_byte_order)
+    throw runtime_error("Dictionary index has the wrong byte order.");
+  if(header.node_size != sizeof(Node))
+    throw runtime_error("Dictionary index has the wrong node size.");
+  // Compare counts rather than sizes, so a huge node_count can't wrap round
+  // to something that looks right.
+  const uint64_t room = (index.size() - sizeof(IndexHeader)) / sizeof(Node);
+  if(header.node_count == 0 ||
+     header.node_count > room ||
+     header.node_count >= npos ||
+     index.size() != sizeof(IndexHeader) + header.node_count * sizeof(Node))
+  {
+    throw runtime_error("Dictionary index is the wrong size.");
+  }
+  if(header.word_count > header.node_count)
+    throw runtime_error("Dictionary index has more words than nodes.");
+
+  _nodes = 
+      reinterpret_cast<const Node *>(index.data() + sizeof(IndexHeader));
+  _node_count = header.node_count;
+  _word_count = header.word_count;
+  _max_length = header.max_length;
+
+  if(verify_checksum && 
+     checksum(_nodes, _node_count * sizeof(Node)) != header.checksum)
+  {
+    throw runtime_error("Dictionary index failed its checksum.");
+  }
+
+  // Whatever the checksum says, a link off the end of the index would have
+  // `child()` read outside the mapping, and a link back round to a node it's
+  // already been through would have it go round forever, so check every one.
+  // `insert()` always puts a node's first child after it, and its next
+  // sibling before it, so every chain of links it makes is finite.
+  for(size_t node = 0; node < _node_count; ++node) {
+    const Node & here = _nodes[node];
+    if((here.first_child != npos && here.first_child >= _node_count) ||
+       (here.next_sibling != npos && here.next_sibling >= _node_count) ||
+       (here.word_index != npos && here.word_index >= _word_count))
+    {
+      throw runtime_error("Dictionary index has a node out of range.");
+    }
+    if((here.first_child != npos && here.first_child <= node) ||
+       (here.next_sibling != npos && here.next_sibling >= node))
+    {
+      throw runtime_error("Dictionary index has a node linked out of order.");
+    }
+  }
+}
+
+void
+boggle::Trie::write(ostream & out) const
+{
+  IndexHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, index_magic, sizeof(index_magic));
+  header.version = index_version;
+  header.byte_order = index_byte_order;
+  header.node_count = _node_count;
+  header.word_count = _word_count;
+  header.node_size = sizeof(Node);
+  header.max_length = _max_length;
+  header.checksum = checksum(_nodes, _node_count * sizeof(Node));
+
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(_nodes), 
+            _node_count * sizeof(Node));
+}
+
+void
+boggle::Trie::insert(const boost::string_view & word)
+{
+  if(_read_only)
+    throw logic_error("Can't insert into a trie loaded from an index.");
+
+  if(word.empty())
+    return;
+
+  uint32_t node = root();
+  for(boost::string_view::const_iterator letter = word.begin(); 
+      letter != word.end(); 
+      ++letter)
+  {
+    uint32_t next = child(node, *letter);
+
+    // Nobody has gone this way before, so make a new node and link it in at
+    // the front of `node`'s children.
+    if(next == npos) {
+      Node added = { npos, _storage[node].first_child, npos, *letter, {} };
+      next = _storage.size();
+      _storage.push_back(added);
+      _storage[node].first_child = next;
+      _nodes = &_storage[0];
+      _node_count = _storage.size();
+    }
+
+    node = next;
+  }
+
+  if(_storage[node].word_index == npos) {
+    _storage[node].word_index = _word_count++;
+    _max_length = max(_max_length, word.size());
+  }
+}
+
+uint32_t
+boggle::Trie::find(const boost::string_view & word) const
+{
+  uint32_t node = root();
+  for(boost::string_view::const_iterator letter = word.begin(); 
+      letter != word.end() && node != npos; 
+      ++letter)
+  {
+    node = child(node, *letter);
+  }
+  return node == npos ? npos : word_index(node);
+}
+
+uint32_t
+boggle::Trie::child(const uint32_t node, const char letter) const
+{
+  for(uint32_t itr = _nodes[node].first_child; 
+      itr != npos; 
+      itr = _nodes[itr].next_sibling)
+  {
+    if(_nodes[itr].letter == letter)
+      return itr;
+  }
+  return npos;
+}
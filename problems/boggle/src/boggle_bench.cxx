@@ -0,0 +1,348 @@
+// Project
+#include <boggle/Board.h>
+#include <boggle/Clock.h>
+#include <boggle/Trie.h>
+
+// STL
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// POSIX
+#include <sys/resource.h>
+
+// boost
+#include <boost/program_options.hpp>
+#include <boost/random/discrete_distribution.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+
+using namespace std;
+
+
+namespace {
+
+/**
+   Relative frequencies of the letters a through z in English text, in percent.
+*/
+const double english_frequencies[26] = {
+  8.2, 1.5, 2.8, 4.3, 12.7, 2.2, 2.0, 6.1, 7.0, 0.2, 0.8, 4.0, 2.4,
+  6.7, 7.5, 1.9, 0.1, 6.0, 6.3, 9.1, 2.8, 1.0, 2.4, 0.2, 2.0, 0.1
+};
+
+typedef boost::random::mt19937 Random_t;
+
+/**
+   Picks letters at random, either uniformly or weighted like English.
+*/
+class LetterGenerator {
+  public:
+  LetterGenerator(const bool english)
+      : _distribution(english ? 
+                      boost::random::discrete_distribution<>(
+                          english_frequencies, english_frequencies + 26) :
+                      boost::random::discrete_distribution<>(
+                          vector<double>(26, 1.0)))
+  {}
+
+  char operator()(Random_t & random) { return 'a' + _distribution(random); }
+
+  private:
+  boost::random::discrete_distribution<> _distribution;
+};
+
+/**
+   \return the most memory this process has had resident, in megabytes.
+*/
+double peak_rss_mb()
+{
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.0;
+}
+
+/**
+   \param length the width and height of the board.
+   \return the text of a random `length` x `length` board.
+*/
+string random_board(const size_t length, 
+                    LetterGenerator & letters, 
+                    Random_t & random)
+{
+  string board;
+  board.reserve(length * (length + 1));
+  for(size_t y = 0; y < length; ++y) {
+    for(size_t x = 0; x < length; ++x) {
+      board.push_back(letters(random));
+    }
+    board.push_back('\n');
+  }
+  return board;
+}
+
+/**
+   \param words how many words to make.
+   \param prefix_sharing the chance, between 0 and 1, that a word starts with
+   some prefix of the word before it, rather than from scratch.
+   \return a sorted dictionary of random words between 3 and 10 letters long.
+*/
+vector<string> random_dictionary(const size_t words,
+                                 const double prefix_sharing,
+                                 LetterGenerator & letters,
+                                 Random_t & random)
+{
+  boost::random::uniform_int_distribution<size_t> lengths(3, 10);
+  boost::random::uniform_real_distribution<> chance(0, 1);
+
+  vector<string> dictionary;
+  dictionary.reserve(words);
+  string word;
+  while(dictionary.size() < words)
+  {
+    const size_t length = lengths(random);
+
+    if(!word.empty() && chance(random) < prefix_sharing) {
+      boost::random::uniform_int_distribution<size_t> keep(1, word.size());
+      word.resize(min(keep(random), length));
+    }
+    else {
+      word.clear();
+    }
+
+    while(word.size() < length) {
+      word.push_back(letters(random));
+    }
+    dictionary.push_back(word);
+  }
+
+  sort(dictionary.begin(), dictionary.end());
+  dictionary.erase(
+      unique(dictionary.begin(), dictionary.end()), dictionary.end());
+  return dictionary;
+}
+
+/**
+   \param board_string the text of the board the words have to be on.
+   \param length the width and height of the board.
+   \param words how many words to make.
+   \return words made by following random paths on the board, so they're 
+   certain to exist on it.
+*/
+vector<string> random_paths(const string & board_string, 
+                            const size_t length,
+                            const size_t words,
+                            Random_t & random)
+{
+  boost::random::uniform_int_distribution<size_t> cells(0, length * length - 1);
+  boost::random::uniform_int_distribution<size_t> lengths(3, 8);
+
+  vector<string> paths;
+  while(paths.size() < words)
+  {
+    const size_t path_length = lengths(random);
+    size_t cell = cells(random);
+    vector<bool> visited(length * length, false);
+    string path;
+
+    // Wander off to a random unvisited neighbor until we're long enough, or 
+    // until we're stuck.
+    while(true) {
+      visited[cell] = true;
+      path.push_back(board_string[(cell / length) * (length + 1) + 
+                                  cell % length]);
+      if(path.size() == path_length)
+        break;
+
+      vector<size_t> next;
+      const int x = cell % length, y = cell / length;
+      for(int next_y = y - 1; next_y <= y + 1; ++next_y) {
+        for(int next_x = x - 1; next_x <= x + 1; ++next_x) {
+          if(next_x < 0 || next_y < 0 || 
+             next_x >= (int)length || next_y >= (int)length)
+            continue;
+          if(!visited[next_y * length + next_x])
+            next.push_back(next_y * length + next_x);
+        }
+      }
+      if(next.empty())
+        break;
+
+      boost::random::uniform_int_distribution<size_t> pick(0, next.size() - 1);
+      cell = next[pick(random)];
+    }
+
+    if(path.size() >= 3)
+      paths.push_back(path);
+  }
+  return paths;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+  boost::program_options::variables_map option_map;
+  try {
+    boost::program_options::options_description description(
+        "Boggle benchmark options");
+
+    description.add_options()
+        ("help", "produce help message")
+
+        ("min_length",
+         boost::program_options::value<size_t>()->default_value(4),
+         "the length of the smallest board to try.")
+
+        ("max_length",
+         boost::program_options::value<size_t>()->default_value(128),
+         "the length of the biggest board to try. Lengths double from "
+         "min_length up to this.")
+
+        ("words",
+         boost::program_options::value<size_t>()->default_value(20000),
+         "how many words to put in the dictionary.")
+
+        ("prefix_sharing",
+         boost::program_options::value<double>()->default_value(0.5),
+         "the chance, between 0 and 1, that a dictionary word shares a prefix "
+         "with the one before it.")
+
+        ("uniform",
+         "pick letters uniformly, rather than weighted like English.")
+
+        ("cache_budget",
+         boost::program_options::value<size_t>()->default_value(256),
+         "roughly how many megabytes each board's word cache may hold.")
+
+        ("probes",
+         boost::program_options::value<size_t>()->default_value(2000),
+         "how many words to time hits and misses with.")
+
+        ("seed",
+         boost::program_options::value<unsigned int>()->default_value(5489),
+         "the random seed.");
+
+    boost::program_options::store(
+        boost::program_options::parse_command_line(argc, argv, description),
+        option_map);
+
+    if(option_map.count("help")) {
+      cout << description << endl;
+      return 1;
+    }
+
+    boost::program_options::notify(option_map);
+  }
+  catch(const boost::program_options::error & error) {
+    cerr << error.what() << endl;
+    return 1;
+  }
+
+  Random_t random(option_map["seed"].as<unsigned int>());
+  LetterGenerator letters(!option_map.count("uniform"));
+
+  const vector<string> dictionary = random_dictionary(
+      option_map["words"].as<size_t>(),
+      option_map["prefix_sharing"].as<double>(),
+      letters,
+      random);
+
+  boggle::Trie trie;
+  for(size_t i = 0; i < dictionary.size(); ++i) {
+    trie.insert(dictionary[i]);
+  }
+
+  const size_t probes = option_map["probes"].as<size_t>();
+  const size_t cache_budget = 
+      option_map["cache_budget"].as<size_t>() * 1024 * 1024;
+
+  cout << setw(7) << "length"
+       << setw(12) << "build_ms"
+       << setw(12) << "hit_ns"
+       << setw(12) << "miss_ns"
+       << setw(14) << "exists_ns/w"
+       << setw(14) << "solve_ns/w"
+       << setw(10) << "found"
+       << setw(12) << "cache_mb"
+       << setw(12) << "peak_rss_mb" << endl;
+
+  for(size_t length = option_map["min_length"].as<size_t>();
+      length <= option_map["max_length"].as<size_t>();
+      length *= 2)
+  {
+    const string board_string = random_board(length, letters, random);
+
+    double start = boggle::seconds();
+    boggle::Board board(board_string);
+    const double build = boggle::seconds() - start;
+    board.set_cache_budget(cache_budget);
+
+    // Hits are random walks on a board of their own, so nothing is cached.
+    const vector<string> hits = 
+        random_paths(board_string, length, probes, random);
+    double hit = 0;
+    if(!hits.empty()) {
+      boggle::Board fresh(board_string);
+      fresh.set_cache_budget(cache_budget);
+      start = boggle::seconds();
+      for(size_t i = 0; i < hits.size(); ++i) {
+        fresh.exists(hits[i]);
+      }
+      hit = (boggle::seconds() - start) / hits.size();
+    }
+
+    // Misses are random dictionary words the board doesn't have.
+    vector<string> misses;
+    for(size_t i = 0; i < dictionary.size() && misses.size() < probes; ++i) {
+      if(!board.exists(dictionary[(i * 7919) % dictionary.size()]))
+        misses.push_back(dictionary[(i * 7919) % dictionary.size()]);
+    }
+    double miss = 0;
+    if(!misses.empty()) {
+      boggle::Board fresh(board_string);
+      fresh.set_cache_budget(cache_budget);
+      start = boggle::seconds();
+      for(size_t i = 0; i < misses.size(); ++i) {
+        fresh.exists(misses[i]);
+      }
+      miss = (boggle::seconds() - start) / misses.size();
+    }
+
+    // The whole dictionary, one word at a time, on a cold cache.
+    boggle::Board cold(board_string);
+    cold.set_cache_budget(cache_budget);
+    start = boggle::seconds();
+    size_t found = 0;
+    for(size_t i = 0; i < dictionary.size(); ++i) {
+      found += cold.exists(dictionary[i]);
+    }
+    const double exists_all = (boggle::seconds() - start) / dictionary.size();
+
+    // And all at once with the trie.
+    start = boggle::seconds();
+    const size_t solved = board.solve(trie).size();
+    const double solve_all = (boggle::seconds() - start) / dictionary.size();
+
+    if(solved != found) {
+      cerr << "exists() found " << found << " words but solve() found "
+           << solved << " on a board of length " << length << endl;
+      return -1;
+    }
+
+    cout << setw(7) << length
+         << setw(12) << fixed << setprecision(3) << build * 1e3
+         << setw(12) << setprecision(0) << hit * 1e9
+         << setw(12) << miss * 1e9
+         << setw(14) << exists_all * 1e9
+         << setw(14) << solve_all * 1e9
+         << setw(10) << found
+         << setw(12) << setprecision(2) 
+         << cold.cache_stats().bytes / (1024.0 * 1024.0)
+         << setw(12) << peak_rss_mb() << endl;
+  }
+
+  return 0;
+}
@@ -1,13 +1,24 @@
 // Project
 #include <boggle/Board.h>
+#include <boggle/Clock.h>
+#include <boggle/MappedFile.h>
+#include <boggle/ParallelSearch.h>
 
 // STL
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 // boost
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/program_options.hpp>
+#include <boost/scoped_ptr.hpp>
 
 using namespace std;
 
@@ -21,12 +32,226 @@ namespace {
 */
 string slurp(const string & filename) 
 {
-  ifstream in;
-  in.open(filename.c_str());
-  stringstream sstr;
-  sstr << in.rdbuf();
-  in.close();
-  return sstr.str();
+  const boggle::MappedFile file(filename);
+  return string(file.data(), file.size());
+}
+
+/**
+   \param path either a directory holding one board per file, or a single file
+   holding many boards, each separated from the next by a blank line.
+   \param names where to put a name for each board: its file name, or the path
+   followed by its position in the file.
+   \param boards where to put the text of each board.
+
+   Throws a std::runtime_error if `path` can't be read.
+*/
+void read_boards(const string & path, 
+                 vector<string> & names, 
+                 vector<string> & boards)
+{
+  if(boost::filesystem::is_directory(path)) {
+    vector<boost::filesystem::path> files;
+    for(boost::filesystem::directory_iterator itr(path);
+        itr != boost::filesystem::directory_iterator();
+        ++itr)
+    {
+      if(boost::filesystem::is_regular_file(itr->status()))
+        files.push_back(itr->path());
+    }
+    sort(files.begin(), files.end());
+
+    BOOST_FOREACH(const boost::filesystem::path & file, files) {
+      names.push_back(file.filename().string());
+      boards.push_back(slurp(file.string()));
+    }
+    return;
+  }
+
+  const boggle::MappedFile file(path);
+  const char * const end = file.data() + file.size();
+  const char * line = file.data();
+  string board;
+  while(line < end)
+  {
+    const char * line_end = find(line, end, '\n');
+    string row(line, line_end);
+    boost::algorithm::trim_right(row);
+    line = line_end + (line_end < end ? 1 : 0);
+
+    if(!row.empty())
+      board += row + "\n";
+
+    if((row.empty() || line == end) && !board.empty()) {
+      names.push_back(
+          path + ":" + boost::lexical_cast<string>(boards.size() + 1));
+      boards.push_back(board);
+      board.clear();
+    }
+  }
+}
+
+/**
+   How long, in seconds, each part of a run took.
+*/
+struct Phases {
+  Phases() : board(0), dictionary(0), solve(0) {}
+
+  /// Reading and parsing the board, or boards.
+  double board;
+
+  /// Reading the dictionary, and building a trie of it if we need one.
+  double dictionary;
+
+  /// Finding the words.
+  double solve;
+};
+
+/**
+   \param text any string.
+   \return `text` as a JSON string, quoted and escaped.
+*/
+string json_string(const string & text)
+{
+  string quoted = "\"";
+  BOOST_FOREACH(const char character, text) {
+    switch(character) {
+      case '"': quoted += "\\\""; break;
+      case '\\': quoted += "\\\\"; break;
+      case '\n': quoted += "\\n"; break;
+      case '\t': quoted += "\\t"; break;
+      default:
+        if(static_cast<unsigned char>(character) < 0x20) {
+          const char * const hex = "0123456789abcdef";
+          quoted += "\\u00";
+          quoted += hex[character >> 4];
+          quoted += hex[character & 0xf];
+        }
+        else {
+          quoted += character;
+        }
+    }
+  }
+  return quoted + "\"";
+}
+
+/**
+   \param out where to write the stats.
+   \param phases how long each part of the run took.
+   \param found how many words were printed.
+   \param stats the counters of the caches used to check words, or NULL if
+   none were.
+   \param one_line whether to write it all on one line, so that it can share
+   a stream with other JSON documents, a line each.
+
+   Writes the stats for a run as a single JSON object.
+*/
+void write_stats(ostream & out, 
+                 const Phases & phases, 
+                 const size_t found,
+                 const boggle::Board::CacheStats * stats,
+                 const bool one_line)
+{
+  // Each line starts with `line` and as many `indent`s as it's deep.
+  const string line = one_line ? " " : "\n";
+  const string indent = one_line ? "" : "  ";
+  const string inner = line + indent;
+  const string field = inner + indent;
+
+  out << "{"
+      << inner << "\"phases\": {"
+      << field << "\"board_seconds\": " << phases.board << ","
+      << field << "\"dictionary_seconds\": " << phases.dictionary << ","
+      << field << "\"solve_seconds\": " << phases.solve
+      << inner << "},"
+      << inner << "\"words\": {";
+  if(stats) {
+    out << field << "\"checked\": " << stats->checked << ","
+        << field << "\"filtered\": " << stats->filtered << ",";
+  }
+  out << field << "\"found\": " << found
+      << inner << "}";
+
+  if(stats) {
+    out << ","
+        << inner << "\"cache\": {"
+        << field << "\"hits\": " << stats->hits << ","
+        << field << "\"misses\": " << stats->misses << ","
+        << field << "\"evictions\": " << stats->evictions << ","
+        << field << "\"game_states\": " << stats->game_states << ","
+        << field << "\"entries\": " << stats->entries << ","
+        << field << "\"bytes\": " << stats->bytes << ","
+        << field << "\"peak_entries\": " << stats->peak_entries << ","
+        << field << "\"peak_bytes\": " << stats->peak_bytes << ","
+        << field << "\"hits_by_prefix_length\": [";
+    for(size_t length = 0; length < stats->hits_by_length.size(); ++length) {
+      out << (length ? ", " : "") << stats->hits_by_length[length];
+    }
+    out << "]"
+        << inner << "},";
+
+    // Only the buckets with something in them, each as the range of 
+    // nanoseconds it covers.
+    out << inner << "\"exists_latency_ns\": [";
+    bool first = true;
+    for(size_t bucket = 0; 
+        bucket < boggle::Board::CacheStats::latency_buckets; 
+        ++bucket)
+    {
+      if(!stats->latency[bucket])
+        continue;
+      out << (first ? "" : ",") << field
+          << "{\"from\": " << (bucket ? uint64_t(1) << bucket : 0)
+          << ", \"to\": " << (uint64_t(1) << (bucket + 1))
+          << ", \"count\": " << stats->latency[bucket] << "}";
+      first = false;
+    }
+    out << (first ? "]" : inner + "]");
+  }
+
+  out << line << "}" << endl;
+}
+
+/**
+   \param option_map the program's options.
+   \return whether the stats go to stderr, which then carries nothing but JSON
+   documents, one per line.
+*/
+bool stats_on_stderr(const boost::program_options::variables_map & option_map)
+{
+  return option_map.count("stats") && !option_map.count("stats_file");
+}
+
+/**
+   \param option_map the program's options.
+   \param phases how long each part of the run took.
+   \param found how many words were printed.
+   \param stats the counters of the caches used to check words, or NULL if
+   none were.
+   \return false if the stats were asked for but couldn't be written.
+
+   Writes the stats for a run, if `--stats` or `--stats_file` were given.
+*/
+bool report(const boost::program_options::variables_map & option_map,
+            const Phases & phases,
+            const size_t found,
+            const boggle::Board::CacheStats * stats = NULL)
+{
+  if(!option_map.count("stats_file")) {
+    if(option_map.count("stats"))
+      write_stats(cerr, phases, found, stats, true);
+    return true;
+  }
+
+  const string filename = option_map["stats_file"].as<string>();
+
+  ofstream out(filename.c_str(), ios::out | ios::trunc);
+  write_stats(out, phases, found, stats, false);
+  out.close();
+  if(!out) {
+    cerr << "Couldn't write stats file: " << filename << endl;
+    return false;
+  }
+  return true;
 }
 
 }
@@ -46,16 +271,75 @@ int main(int argc, char* argv[])
     description.add_options()
         ("help", "produce help message")
 
+        ("solve_all",
+         "load the whole dictionary into a trie and find every word in a "
+         "single pass over the board, rather than checking words one by one.")
+
+        ("cache_budget",
+         boost::program_options::value<size_t>()->default_value(0),
+         "roughly how many megabytes the cache used to check words may hold "
+         "before it starts evicting prefixes. 0 means no limit.")
+
+        ("threads",
+         boost::program_options::value<unsigned int>()->default_value(1),
+         "how many threads to check words with.")
+
+        ("stats",
+         "write how long each phase took and how the cache did to stderr, as "
+         "JSON on a single line, and nothing else but errors, themselves a "
+         "JSON object a line. Timing every word slows checking them down a "
+         "little.")
+
+        ("stats_file",
+         boost::program_options::value<string>(),
+         "write the stats to this file rather than stderr. Implies --stats.")
+
+        ("build_index",
+         boost::program_options::value<string>(),
+         "the path of a dictionary file to build an index from, written to "
+         "--output. Nothing is solved.")
+
+        ("output,o",
+         boost::program_options::value<string>(),
+         "where --build_index writes the index.")
+
+        ("index",
+         boost::program_options::value<string>(),
+         "the path of an index written by --build_index, used in place of "
+         "dictionary_file. Implies --solve_all.")
+
+        ("verify_index",
+         "check the whole of --index against its checksum before using it.")
+
+        ("batch",
+         boost::program_options::value<string>(),
+         "the path of a directory of board files, or of a file of boards "
+         "separated by blank lines, to solve in place of board_file. Prints "
+         "one line per board: its name, then every word found on it.")
+
         ("board_file",
-         boost::program_options::value<string>()->required(),
+         boost::program_options::value<string>(),
          "the path of the file containing the board.")
 
         ("dictionary_file",
-         boost::program_options::value<string>()->required(),
+         boost::program_options::value<string>(),
          "the path of the file containing the words defined as valid.");
 
+    // With --batch, the only positional argument is the dictionary. Find out
+    // whether it was given with a first pass that takes no positional
+    // arguments at all, and leaves them to the second.
+    boost::program_options::variables_map first_pass;
+    boost::program_options::store(
+        boost::program_options::command_line_parser(argc, argv)
+        .options(description)
+        .allow_unregistered()
+        .run(),
+        first_pass);
+    const bool batch = first_pass.count("batch");
+
     boost::program_options::positional_options_description postional_arguments;
-    postional_arguments.add("board_file", 1);
+    if(!batch)
+      postional_arguments.add("board_file", 1);
     postional_arguments.add("dictionary_file", 2);
 
     boost::program_options::store(
@@ -71,6 +355,20 @@ int main(int argc, char* argv[])
     }
 
     boost::program_options::notify(option_map);
+
+    if(option_map.count("build_index")) {
+      if(!option_map.count("output")) {
+        throw boost::program_options::required_option("output");
+      }
+    }
+    else {
+      if(!option_map.count("board_file") && !option_map.count("batch")) {
+        throw boost::program_options::required_option("board_file");
+      }
+      if(!option_map.count("dictionary_file") && !option_map.count("index")) {
+        throw boost::program_options::required_option("dictionary_file");
+      }
+    }
   }
   catch(const boost::program_options::error & error) {
     cerr << error.what() << endl;
@@ -78,6 +376,128 @@ int main(int argc, char* argv[])
   }
 
 
+  //////////////////////////////
+  // Build A Dictionary Index //
+  //////////////////////////////
+
+  if(option_map.count("build_index")) {
+    const string filename = option_map["build_index"].as<string>();
+    boost::scoped_ptr<boggle::MappedFile> in;
+    try {
+      in.reset(new boggle::MappedFile(filename));
+    }
+    catch(const runtime_error & error) {
+      cerr << "Couldn't open dictionary file: " << filename << endl;
+      return -1;
+    }
+
+    boggle::Trie dictionary;
+    boggle::WordReader reader(*in);
+    boost::string_view view;
+    while(reader.next(view)) {
+      dictionary.insert(view);
+    }
+
+    const string output = option_map["output"].as<string>();
+    ofstream out(output.c_str(), ios::out | ios::binary | ios::trunc);
+    dictionary.write(out);
+    out.close();
+    if(!out) {
+      cerr << "Couldn't write index file: " << output << endl;
+      return -1;
+    }
+
+    return 0;
+  }
+
+
+  //////////////////////////
+  // Solve Lots Of Boards //
+  //////////////////////////
+
+  if(option_map.count("batch")) {
+    const double start = boggle::seconds();
+    Phases phases;
+
+    vector<string> names, boards;
+    try {
+      read_boards(option_map["batch"].as<string>(), names, boards);
+    }
+    catch(const exception & error) {
+      cerr << "Couldn't read boards: " << error.what() << endl;
+      return -1;
+    }
+    phases.board = boggle::seconds() - start;
+
+    // Load the dictionary once, from an index if we have one.
+    boost::scoped_ptr<boggle::MappedFile> in;
+    boost::scoped_ptr<boggle::Trie> dictionary;
+    try {
+      if(option_map.count("index")) {
+        in.reset(new boggle::MappedFile(option_map["index"].as<string>()));
+        dictionary.reset(
+            new boggle::Trie(*in, option_map.count("verify_index")));
+      }
+      else {
+        in.reset(
+            new boggle::MappedFile(option_map["dictionary_file"].as<string>()));
+        dictionary.reset(new boggle::Trie());
+        boggle::WordReader reader(*in);
+        boost::string_view view;
+        while(reader.next(view)) {
+          dictionary->insert(view);
+        }
+      }
+    }
+    catch(const runtime_error & error) {
+      cerr << "Couldn't load dictionary: " << error.what() << endl;
+      return -1;
+    }
+
+    const double solve_start = boggle::seconds();
+    phases.dictionary = solve_start - start - phases.board;
+    vector<string> errors;
+    const vector<vector<string> > found = boggle::solve(
+        boards, *dictionary, option_map["threads"].as<unsigned int>(), &errors);
+    const double end = boggle::seconds();
+    phases.solve = end - solve_start;
+
+    size_t printed = 0;
+    for(size_t board = 0; board < boards.size(); ++board)
+    {
+      if(!errors[board].empty()) {
+        if(stats_on_stderr(option_map)) {
+          cerr << "{\"board\": " << json_string(names[board])
+               << ", \"error\": " << json_string(errors[board]) << "}" << endl;
+        }
+        else {
+          cerr << names[board] << ": " << errors[board] << endl;
+        }
+        continue;
+      }
+
+      cout << names[board];
+      BOOST_FOREACH(const string & word, found[board]) {
+        if(word.size() >= 3) {
+          cout << " " << word;
+          ++printed;
+        }
+      }
+      cout << "\n";
+    }
+    cout << flush;
+
+    // The stats say as much, as JSON.
+    if(!stats_on_stderr(option_map)) {
+      cerr << boards.size() << " boards in " << (end - start) << "s, "
+           << (boards.size() / (end - solve_start)) << " boards/s solving, "
+           << (boards.size() / (end - start)) << " boards/s overall" << endl;
+    }
+
+    return report(option_map, phases, printed) ? 0 : -1;
+  }
+
+
   ////////////////////
   // Solve The Game //
   ////////////////////
@@ -86,31 +506,170 @@ int main(int argc, char* argv[])
     using boggle::Board;
     using boggle::Point;
 
-    // Construct the board
-    Board board(slurp(option_map["board_file"].as<string>()));
+    // Construct the board, a row at a time.
+    Phases phases;
+    double start = boggle::seconds();
+    const string board_filename = option_map["board_file"].as<string>();
+    ifstream board_stream(board_filename.c_str());
+    if(!board_stream.is_open()) {
+      cerr << "Couldn't read board file: " << board_filename << endl;
+      return -1;
+    }
+    Board board(board_stream);
+    board_stream.close();
+    phases.board = boggle::seconds() - start;
+    start = boggle::seconds();
+
+    // Use a prebuilt index in place, rather than reading the dictionary.
+    if(option_map.count("index")) {
+      const string filename = option_map["index"].as<string>();
+      boost::scoped_ptr<boggle::MappedFile> index;
+      boost::scoped_ptr<boggle::Trie> dictionary;
+      try {
+        index.reset(new boggle::MappedFile(filename));
+        dictionary.reset(
+            new boggle::Trie(*index, option_map.count("verify_index")));
+      }
+      catch(const runtime_error & error) {
+        cerr << "Couldn't load index file: " << filename << ": "
+             << error.what() << endl;
+        return -1;
+      }
+      phases.dictionary = boggle::seconds() - start;
+      start = boggle::seconds();
+
+      const vector<string> words = board.solve(*dictionary);
+      phases.solve = boggle::seconds() - start;
+
+      size_t printed = 0;
+      for(vector<string>::const_iterator word = words.begin();
+          word != words.end();
+          ++word)
+      {
+        if(word->size() >= 3) {
+          cout << *word << endl;
+          ++printed;
+        }
+      }
+      cout << endl;
+
+      return report(option_map, phases, printed) ? 0 : -1;
+    }
 
-    // Open the dictionary file
+    // Map the dictionary file. Words are read straight out of the mapping 
+    // rather than copied out line by line.
     const string filename = option_map["dictionary_file"].as<string>();
-    ifstream in(filename.c_str());
-    if(!in.is_open()) {
+    boost::scoped_ptr<boggle::MappedFile> in;
+    try {
+      in.reset(new boggle::MappedFile(filename));
+    }
+    catch(const runtime_error & error) {
       cerr << "Couldn't open dictionary file: " << filename << endl;
       return -1;
     }
+    boggle::WordReader reader(*in);
+    boost::string_view view;
+
+    // Load the dictionary into a trie and walk the board once.
+    if(option_map.count("solve_all")) {
+      boggle::Trie dictionary;
+      while(reader.next(view)) {
+        dictionary.insert(view);
+      }
+      phases.dictionary = boggle::seconds() - start;
+      start = boggle::seconds();
+
+      const vector<string> words = board.solve(dictionary);
+      phases.solve = boggle::seconds() - start;
+
+      size_t printed = 0;
+      for(vector<string>::const_iterator word = words.begin();
+          word != words.end();
+          ++word)
+      {
+        if(word->size() >= 3) {
+          cout << *word << endl;
+          ++printed;
+        }
+      }
+      cout << endl;
+
+      return report(option_map, phases, printed) ? 0 : -1;
+    }
+
+    // Keep the word cache within its budget, if we were given one, and time
+    // every word if we've been asked for stats.
+    const size_t cache_budget = option_map["cache_budget"].as<size_t>();
+    board.set_cache_budget(cache_budget * 1024 * 1024);
+    const bool timing = 
+        option_map.count("stats") || option_map.count("stats_file");
+    board.set_cache_timing(timing);
+
+    // Spread the words over several threads, each with a cache of its own.
+    const unsigned int threads = option_map["threads"].as<unsigned int>();
+    if(threads > 1) {
+      vector<string> words;
+      while(reader.next(view)) {
+        words.push_back(string(view.begin(), view.end()));
+      }
+      phases.dictionary = boggle::seconds() - start;
+      start = boggle::seconds();
+
+      Board::CacheStats stats;
+      const vector<char> found = boggle::exists(
+          board, words, threads, cache_budget * 1024 * 1024, &stats, timing);
+      phases.solve = boggle::seconds() - start;
+
+      size_t printed = 0;
+      for(size_t i = 0; i < words.size(); ++i) {
+        if(found[i] && words[i].size() >= 3) {
+          cout << words[i] << endl;
+          ++printed;
+        }
+      }
+      cout << endl;
+
+      if(cache_budget && !stats_on_stderr(option_map)) {
+        cerr << "cache hits: " << stats.hits
+             << ", misses: " << stats.misses
+             << ", evictions: " << stats.evictions
+             << ", bytes: " << stats.bytes << endl;
+      }
+
+      return report(option_map, phases, printed, &stats) ? 0 : -1;
+    }
 
-    // Check each word in the dictionary.
-    while(in.good()) {
-      string word;
-      getline(in, word);
+    // Check each word in the dictionary. Reusing the one string means we 
+    // only allocate when we see a longer word than any before it.
+    string word;
+    size_t printed = 0;
+    while(reader.next(view)) {
+      word.assign(view.begin(), view.end());
 
       // The reason we even bother checking words under 3 characters, even 
       // though they're not allowed by the rules of the game, is to prime the
       // cache. This assumes our dictionary is such that we have a lot of common
       // prefixes, which may or may not be true.
-      if(board.exists(word) && word.size() >= 3)
+      if(board.exists(word) && word.size() >= 3) {
         cout << word << endl;
+        ++printed;
+      }
     }
     cout << endl;
 
-    in.close();
+    const Board::CacheStats & stats = board.cache_stats();
+    if(cache_budget && !stats_on_stderr(option_map)) {
+      cerr << "cache hits: " << stats.hits
+           << ", misses: " << stats.misses
+           << ", evictions: " << stats.evictions
+           << ", bytes: " << stats.bytes << endl;
+    }
+
+    // Reading words and checking them are interleaved, so whatever time 
+    // wasn't spent in `exists()` was spent reading.
+    phases.solve = stats.nanoseconds / 1e9;
+    phases.dictionary = boggle::seconds() - start - phases.solve;
+
+    return report(option_map, phases, printed, &stats) ? 0 : -1;
   }
 }
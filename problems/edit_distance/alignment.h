@@ -0,0 +1,274 @@
+#ifndef ALIGNMENT_H
+#define ALIGNMENT_H
+
+// Project
+#include "edit_distance.h"
+#include "hirschberg.h"
+
+// STL
+#include <algorithm>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+   Not just how far apart two strings are, but the edits that get from one to
+   the other: an edit script, which lines the two strings up, or reads as a
+   diff.
+
+   The script comes from `hirschberg()`, so it takes O(|lhs| + |rhs|) memory
+   rather than the whole table.
+
+   The rows come from `last_row()`: a Pattern, 64 cells at a time, when every
+   edit costs one, and otherwise strips that keep the row in cache.
+*/
+namespace edit {
+
+/**
+   What an edit does.
+*/
+enum Operation {
+  // Keeps characters that are the same in both.
+  match,
+
+  // Swaps characters of `lhs` for ones of `rhs`.
+  substitution,
+
+  // Adds characters of `rhs`.
+  insertion,
+
+  // Drops characters of `lhs`.
+  deletion
+};
+
+/**
+   A run of the same operation on neighbouring characters.
+*/
+struct Edit {
+  Edit(const Operation operation,
+       const size_t lhs,
+       const size_t rhs,
+       const size_t length)
+      : operation(operation), lhs(lhs), rhs(rhs), length(length)
+  {}
+
+  Operation operation;
+
+  /**
+     Where the run starts in `lhs` and in `rhs`.
+  */
+  size_t lhs;
+  size_t rhs;
+
+  /**
+     How many characters it covers, of `lhs` or `rhs` or both.
+  */
+  size_t length;
+};
+
+/**
+   The edits that turn `lhs` into `rhs`, in order.
+*/
+typedef std::vector<Edit> Script;
+
+/**
+   \param lhs the string to edit.
+   \param rhs what to edit it into.
+   \param costs what each kind of edit costs.
+   \param operations where to add the cheapest script's operations, one per
+   character, in order.
+
+   Fills in the whole table and walks back from the bottom right corner.
+*/
+inline void traceback(const std::string & lhs,
+                      const std::string & rhs,
+                      const Costs & costs,
+                      std::vector<Operation> & operations)
+{
+  const size_t columns = rhs.size() + 1;
+  std::vector<size_t> table((lhs.size() + 1) * columns);
+  for(size_t j = 0; j < columns; ++j)
+    table[j] = j * costs.insertion;
+  for(size_t i = 1; i <= lhs.size(); ++i) {
+    size_t * const row = &table[i * columns];
+    const size_t * const above = row - columns;
+    row[0] = i * costs.deletion;
+    for(size_t j = 1; j < columns; ++j) {
+      size_t best = above[j - 1] +
+          (lhs[i - 1] == rhs[j - 1] ? 0 : costs.substitution);
+      best = std::min(best, above[j] + costs.deletion);
+      best = std::min(best, row[j - 1] + costs.insertion);
+      row[j] = best;
+    }
+  }
+
+  const size_t start = operations.size();
+  size_t i = lhs.size();
+  size_t j = rhs.size();
+  while(i || j) {
+    const size_t here = table[i * columns + j];
+    if(i && j) {
+      const bool same = lhs[i - 1] == rhs[j - 1];
+      const size_t diagonal = table[(i - 1) * columns + j - 1];
+      if(here == diagonal + (same ? 0 : costs.substitution)) {
+        operations.push_back(same ? match : substitution);
+        --i;
+        --j;
+        continue;
+      }
+    }
+    if(i && here == table[(i - 1) * columns + j] + costs.deletion) {
+      operations.push_back(deletion);
+      --i;
+    }
+    else {
+      operations.push_back(insertion);
+      --j;
+    }
+  }
+  std::reverse(operations.begin() + start, operations.end());
+}
+
+/**
+   What `hirschberg()` needs to score a table of edits: its last rows from
+   `last_row()`, and whole small ones from `traceback()`.
+*/
+struct Scripter {
+  explicit Scripter(const Costs & costs)
+      : costs(costs)
+  {}
+
+  void operator()(const std::string & lhs,
+                  const std::string & rhs,
+                  std::vector<size_t> & distances) const
+  {
+    last_row(lhs, rhs, costs, distances);
+  }
+
+  void operator()(const std::string & lhs,
+                  const std::string & rhs,
+                  std::vector<Operation> & operations) const
+  {
+    traceback(lhs, rhs, costs, operations);
+  }
+
+  Costs costs;
+};
+
+/**
+   \param lhs the string to edit.
+   \param rhs what to edit it into.
+   \param costs what each kind of edit costs.
+   \param threads how many threads to work it out with.
+   \return the cheapest edits that turn `lhs` into `rhs`, with neighbouring
+   edits of the same kind run together.
+*/
+inline Script script(const std::string & lhs,
+                     const std::string & rhs,
+                     const Costs & costs = Costs(),
+                     const unsigned int threads = 1)
+{
+  std::vector<Operation> operations;
+  const Scripter scripter(costs);
+  hirschberg(lhs, rhs, scripter, scripter, std::less<size_t>(),
+             std::max(threads, 1u), operations);
+
+  Script edits;
+  size_t i = 0;
+  size_t j = 0;
+  for(size_t k = 0; k < operations.size(); ++k) {
+    const Operation operation = operations[k];
+    if(!edits.empty() && edits.back().operation == operation)
+      ++edits.back().length;
+    else
+      edits.push_back(Edit(operation, i, j, 1));
+    if(operation != insertion)
+      ++i;
+    if(operation != deletion)
+      ++j;
+  }
+  return edits;
+}
+
+/**
+   \param edits a script.
+   \param costs what each kind of edit costs.
+   \return what the script costs.
+*/
+inline size_t cost(const Script & edits, const Costs & costs = Costs())
+{
+  size_t total = 0;
+  for(size_t k = 0; k < edits.size(); ++k) {
+    switch(edits[k].operation) {
+      case match: break;
+      case substitution: total += edits[k].length * costs.substitution; break;
+      case insertion: total += edits[k].length * costs.insertion; break;
+      case deletion: total += edits[k].length * costs.deletion; break;
+    }
+  }
+  return total;
+}
+
+/**
+   \param lhs the string the script edits.
+   \param rhs what it edits it into.
+   \param edits the script.
+   \param gap what to fill the other string with across an insertion or a
+   deletion.
+   \return `lhs` and `rhs`, the same length, with every character the script
+   keeps or substitutes lined up with the one it keeps or substitutes it for.
+*/
+inline std::pair<std::string, std::string>
+align(const std::string & lhs,
+      const std::string & rhs,
+      const Script & edits,
+      const char gap = '-')
+{
+  std::pair<std::string, std::string> aligned;
+  for(size_t k = 0; k < edits.size(); ++k) {
+    const Edit & edit = edits[k];
+    if(edit.operation == insertion)
+      aligned.first.append(edit.length, gap);
+    else
+      aligned.first.append(lhs, edit.lhs, edit.length);
+    if(edit.operation == deletion)
+      aligned.second.append(edit.length, gap);
+    else
+      aligned.second.append(rhs, edit.rhs, edit.length);
+  }
+  return aligned;
+}
+
+/**
+   \param out where to write the diff.
+   \param lhs the string the script edits.
+   \param rhs what it edits it into.
+   \param edits the script.
+
+   Writes a line per edit, the way diff does: what's kept starts with a
+   space, what's dropped from `lhs` with a '-', and what's added from `rhs`
+   with a '+'. A substitution is a '-' line and then a '+' line.
+*/
+inline void write_diff(std::ostream & out,
+                       const std::string & lhs,
+                       const std::string & rhs,
+                       const Script & edits)
+{
+  for(size_t k = 0; k < edits.size(); ++k) {
+    const Edit & edit = edits[k];
+    if(edit.operation == match) {
+      out << ' ' << lhs.substr(edit.lhs, edit.length) << '\n';
+      continue;
+    }
+    if(edit.operation != insertion)
+      out << '-' << lhs.substr(edit.lhs, edit.length) << '\n';
+    if(edit.operation != deletion)
+      out << '+' << rhs.substr(edit.rhs, edit.length) << '\n';
+  }
+}
+
+}
+
+#endif
@@ -1,5 +1,13 @@
+// Project
+#include "alignment.h"
+#include "edit_distance.h"
+#include "lexicon.h"
+#include "palindrome.h"
+
+// STL
 #include <algorithm>
-#include <limits.h>
+#include <cerrno>
+#include <cstdlib>
 #include <iostream>
 #include <iomanip>
 #include <string>
@@ -9,64 +17,55 @@ using namespace std;
 
 int edit_distance(const string & lhs, const string & rhs)
 {
-  // Initialize DP table
-  vector< vector<int> > edit_distances(
-      lhs.size() + 1, vector<int>(rhs.size()+1, 0));
-  for(int i = 0; i <= lhs.size(); ++i)
-    edit_distances[i][0] = i;
-  for(int j = 0; j <= rhs.size(); ++j)
-    edit_distances[0][j] = j;
-
-  // Populate DP table
-  vector<int> costs(3, 0);
-  for(int i = 1; i < lhs.size(); ++i) {
-    for(int j = 1; j < rhs.size(); ++j) {
-
-      costs[0] = edit_distances[i-1][j-1] + (lhs[i-1] == rhs[j-1] ? 0 : 1);
-      costs[1] = edit_distances[i][j-1] + 1;
-      costs[2] = edit_distances[i-1][j] + 1;
-
-      edit_distances[i][j] = *min_element(costs.begin(), costs.end());
-    }
-  }
-
-  // Return edit distance
-  return edit_distances[lhs.size()][rhs.size()];
+  return edit::distance(lhs, rhs);
 }
 
 
 bool is_k_palindrome(const string & word, const int k)
 {
-  const string reverse_word(word.rbegin(), word.rend());
-
-  // Initialize DP table
-  vector< vector<int> > edit_distances(
-      word.size()+1, vector<int>(word.size()+1, 0));
-
-  for(int i = 0; i <= word.size(); ++i)
-    edit_distances[i][0] = i;
-  for(int j = 0; j <= reverse_word.size(); ++j)
-    edit_distances[0][j] = j;
-
-
-  // Populate DP table
-  vector<int> costs(3, 0);
-  for(int i = 1; i <= word.size(); ++i) {
-    for(int j = 1; j <= word.size()); ++j) {
-
-      costs[0] = (word[i-1] == reverse_word[j-1] ? edit_distances[i-1][j-1] : INT_MAX);
-      costs[1] = edit_distances[i][j-1] + 1;
-      costs[2] = edit_distances[i-1][j] + 1;
-
-      edit_distances[i][j] = *min_element(costs.begin(), costs.end());
-    }
-  }
+  return k >= 0 && edit::is_k_palindrome(word, k);
+}
 
-  return edit_distances[word.size()][word.size()] <= 2*k;
+/**
+   \param text what was given for k.
+   \param k set to it, if it's a number.
+   \return false unless `text` is nothing but decimal digits, and not too big
+   a number for a size_t.
+*/
+bool parse_k(const string & text, size_t & k)
+{
+  if(text.empty() || text.find_first_not_of("0123456789") != string::npos)
+    return false;
+  errno = 0;
+  const unsigned long long value = strtoull(text.c_str(), NULL, 10);
+  if(errno == ERANGE || value > static_cast<size_t>(-1))
+    return false;
+  k = value;
+  return true;
 }
 
 int main(int argc, char *argv[])
 {
+  // Given a file and k, says whether the file is a k-palindrome.
+  if(argc == 3) {
+    size_t k;
+    if(!parse_k(argv[2], k)) {
+      cerr << "Usage: " << argv[0] << " <file> <k>" << endl
+           << "where k, how many bytes may be taken out of the file, is a "
+           << "whole number." << endl;
+      return 1;
+    }
+    try {
+      const bool palindrome = edit::is_k_palindrome_file(argv[1], k);
+      cout << (palindrome ? "true" : "false") << endl;
+      return 0;
+    }
+    catch(const exception & error) {
+      cerr << error.what() << endl;
+      return 1;
+    }
+  }
+
   string test = "";
   for(int i = 0; i < 10000; ++i) {
     test.push_back((char)((rand() % 26) + 97));
@@ -76,5 +75,30 @@ int main(int argc, char *argv[])
   cout << test+test_reverse << endl;
   cout << (is_k_palindrome(test+test_reverse+"asdasd", 1) ? "true" : "false") << endl;
 
+  // The cheapest edits from one word to another, as a diff.
+  const string lhs = "kitten";
+  const string rhs = "sitting";
+  const edit::Script edits = edit::script(lhs, rhs);
+  cout << edit::cost(edits) << " edits from " << lhs << " to " << rhs << ":"
+       << endl;
+  edit::write_diff(cout, lhs, rhs, edits);
+
+  // Every random word within two edits of another one.
+  vector<string> words;
+  for(int i = 0; i < 10000; ++i) {
+    string word;
+    for(int length = 3 + rand() % 4; length > 0; --length)
+      word.push_back((char)((rand() % 26) + 97));
+    words.push_back(word);
+  }
+  const edit::Lexicon lexicon(words);
+  const string & query = words[rand() % words.size()];
+  const vector<edit::Match> matches = lexicon.search(query, 2, 4);
+  cout << matches.size() << " words within 2 of " << query << ":" << endl;
+  for(size_t i = 0; i < matches.size(); ++i) {
+    cout << "  " << lexicon[matches[i].word] << " (" << matches[i].distance
+         << ")" << endl;
+  }
+
   return 0;
 }
@@ -0,0 +1,471 @@
+#ifndef EDIT_DISTANCE_H
+#define EDIT_DISTANCE_H
+
+// STL
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// POSIX
+#include <stdint.h>
+
+/**
+   The Levenshtein distance between two strings: how few single character
+   insertions, deletions and substitutions turn one into the other.
+
+   None of these keep the whole (|lhs|+1)x(|rhs|+1) table; they only ever
+   need as much as one row or column of it, the shorter one, so strings of
+   hundreds of thousands of characters are fine:
+
+   - `distance(lhs, rhs)` counts every edit as one, and works out 64 rows of
+     the table at a time, with Myers' bit-vector algorithm as Hyyro extended it
+     to patterns longer than a machine word. A Pattern does the same for one
+     string measured against many;
+   - `distance(lhs, rhs, costs)` lets each kind of edit cost something
+     different, and works down the table a strip of columns at a time, so the
+     row it's working on stays in cache;
+   - `bounded_distance(lhs, rhs, k)` is for when only distances up to `k`
+     matter. It only looks at cells within `k` of the diagonal, and gives up as
+     soon as it can tell the distance is more than `k`.
+*/
+namespace edit {
+
+/**
+   What each kind of edit costs.
+*/
+struct Costs {
+  explicit Costs(const unsigned int insertion = 1,
+                 const unsigned int deletion = 1,
+                 const unsigned int substitution = 1)
+      : insertion(insertion), deletion(deletion), substitution(substitution)
+  {}
+
+  /**
+     Adding a character that's in `rhs` but not `lhs`.
+  */
+  unsigned int insertion;
+
+  /**
+     Dropping a character that's in `lhs` but not `rhs`.
+  */
+  unsigned int deletion;
+
+  /**
+     Swapping a character of `lhs` for one of `rhs`.
+  */
+  unsigned int substitution;
+};
+
+/**
+   How many columns `distance(lhs, rhs, costs)` works down at once; enough
+   that a strip of the table's row fits comfortably in L1.
+*/
+const size_t strip_columns = 2048;
+
+/**
+   \param lhs the string to edit, down the table's rows.
+   \param rhs what to edit it into, across its columns.
+   \param costs what each kind of edit costs.
+   \param row if not NULL, where to put the table's last row, less its first
+   cell.
+   \return the cheapest way of turning `lhs` into `rhs`.
+
+   Works across `rhs` a strip of `strip_columns` at a time, keeping the
+   column between the last strip and the next, as long as `lhs`, and the row
+   of the strip it's on. That's O(|lhs|) memory, and the row never leaves
+   cache, however long the strings get.
+*/
+inline size_t strips(const std::string & lhs,
+                     const std::string & rhs,
+                     const Costs & costs,
+                     size_t * const row)
+{
+  const size_t insertion = costs.insertion;
+  const size_t deletion = costs.deletion;
+  const size_t substitution = costs.substitution;
+
+  // column[i] is the cost of turning lhs[0, i) into the columns before the
+  // strip, and strip_row[t] that of turning lhs[0, i) into rhs[0, start + t).
+  std::vector<size_t> column(lhs.size() + 1);
+  for(size_t i = 0; i <= lhs.size(); ++i)
+    column[i] = i * deletion;
+  std::vector<size_t> strip_row(strip_columns + 1);
+
+  for(size_t start = 0; start < rhs.size(); start += strip_columns) {
+    const size_t width = std::min(strip_columns, rhs.size() - start);
+    const char * const strip = rhs.data() + start;
+
+    for(size_t t = 0; t <= width; ++t)
+      strip_row[t] = (start + t) * insertion;
+    column[0] = strip_row[width];
+
+    for(size_t i = 1; i <= lhs.size(); ++i) {
+      const char character = lhs[i - 1];
+      size_t diagonal = strip_row[0];
+      strip_row[0] = column[i];
+      for(size_t t = 1; t <= width; ++t) {
+        const size_t above = strip_row[t];
+        size_t best =
+            diagonal + (character == strip[t - 1] ? 0 : substitution);
+        best = std::min(best, above + deletion);
+        best = std::min(best, strip_row[t - 1] + insertion);
+        strip_row[t] = best;
+        diagonal = above;
+      }
+      column[i] = strip_row[width];
+    }
+
+    if(row)
+      std::copy(&strip_row[1], &strip_row[width] + 1, row + start);
+  }
+
+  return column[lhs.size()];
+}
+
+/**
+   \param lhs the string to edit.
+   \param rhs what to edit it into.
+   \param costs what each kind of edit costs.
+   \return the cheapest way of turning `lhs` into `rhs`.
+
+   Runs the strips across the longer string, so it takes
+   O(min(|lhs|,|rhs|)) memory.
+*/
+inline size_t distance(const std::string & lhs,
+                       const std::string & rhs,
+                       const Costs & costs)
+{
+  // Turning rhs into lhs takes the same edits as the other way around, with
+  // insertions and deletions swapped.
+  if(rhs.size() < lhs.size()) {
+    const Costs swapped(costs.deletion, costs.insertion, costs.substitution);
+    return strips(rhs, lhs, swapped, NULL);
+  }
+  return strips(lhs, rhs, costs, NULL);
+}
+
+typedef uint64_t Word;
+
+/**
+   How many rows of the table a Word holds.
+*/
+const size_t word_bits = 64;
+
+/**
+   \param positive whether each of a block's cells is one more than the one
+   above it, in the last column, and updated to say the same of the next.
+   \param negative the same, for whether they're one less.
+   \param equal which of the block's characters match the next column's.
+   \param carry +1, 0 or -1: how much more the cell just above the block is in
+   the next column than in the last.
+   \return the same for the block's last cell, to carry into the next block.
+
+   One step of Myers' bit-vector algorithm, as Hyyro cut it up into blocks.
+*/
+inline int advance(Word & positive,
+                   Word & negative,
+                   Word equal,
+                   const int carry)
+{
+  const Word high_bit = Word(1) << (word_bits - 1);
+
+  const Word xv = equal | negative;
+  if(carry < 0)
+    equal |= 1;
+  const Word xh = (((equal & positive) + positive) ^ positive) | equal;
+  Word ph = negative | ~(xh | positive);
+  Word mh = positive & xh;
+
+  const int out = (ph & high_bit) ? 1 : (mh & high_bit) ? -1 : 0;
+  ph <<= 1;
+  mh <<= 1;
+  if(carry < 0)
+    mh |= 1;
+  else if(carry > 0)
+    ph |= 1;
+  positive = mh | ~(xv | ph);
+  negative = ph & xv;
+  return out;
+}
+
+/**
+   A string cut into 64 character blocks, with a bit vector per block for
+   each different character in it saying where that character is, ready to
+   be measured against any number of others.
+*/
+class Pattern {
+  public:
+  explicit Pattern(const std::string & pattern)
+      : _pattern(pattern),
+        _blocks((pattern.size() + word_bits - 1) / word_bits),
+        _past_end(0),
+        _symbols(256, 0)
+  {
+    const size_t padding = _blocks * word_bits - pattern.size();
+    if(padding)
+      _past_end = ~Word(0) << (word_bits - padding);
+
+    // Symbols are only handed out to the characters the pattern holds; every
+    // other character is symbol 0, and matches nothing.
+    size_t alphabet = 1;
+    for(size_t i = 0; i < pattern.size(); ++i) {
+      size_t & symbol = _symbols[static_cast<unsigned char>(pattern[i])];
+      if(!symbol)
+        symbol = alphabet++;
+    }
+    _matches.resize(alphabet * _blocks, 0);
+    for(size_t i = 0; i < pattern.size(); ++i) {
+      const size_t symbol = _symbols[static_cast<unsigned char>(pattern[i])];
+      _matches[symbol * _blocks + i / word_bits] |=
+          Word(1) << (i % word_bits);
+    }
+  }
+
+  const std::string & pattern() const
+  {
+    return _pattern;
+  }
+
+  /**
+     \param text the string to measure against.
+     \return how few insertions, deletions and substitutions turn the pattern
+     into `text`.
+
+     Each column of the table, one per character of `text`, is worked out a
+     block at a time with a handful of word operations: each block keeps only
+     whether each of its cells is one more or one less than the one above, and
+     passes whether its last cell is one more or one less than the one to its
+     left down to the next block. That's O(|pattern||text|/64) time, and for a
+     pattern of 64 characters or fewer, nothing on the heap.
+  */
+  size_t distance(const std::string & text) const
+  {
+    return scan(text, NULL);
+  }
+
+  /**
+     \param text the string to measure against.
+     \param distances resized to |text| + 1, with element `j` set to how far
+     the pattern is from the first `j` characters of `text`: the table's last
+     row.
+  */
+  void last_row(const std::string & text,
+                std::vector<size_t> & distances) const
+  {
+    distances.resize(text.size() + 1);
+    distances[0] = _pattern.size();
+    scan(text, &distances[0] + 1);
+  }
+
+  private:
+  /**
+     \param text the string to measure against.
+     \param row if not NULL, where to put the table's last row, less its first
+     cell.
+     \return the table's bottom right cell.
+  */
+  size_t scan(const std::string & text, size_t * const row) const
+  {
+    if(_pattern.empty()) {
+      for(size_t j = 0; row && j < text.size(); ++j)
+        row[j] = j + 1;
+      return text.size();
+    }
+
+    // Whether each cell is one more (positive) or one less (negative) than
+    // the one above it. The first column counts up from the top, and so does
+    // the top row, from the left.
+    //
+    // score is the bottom cell of the last block, which runs past the end of
+    // the pattern unless it's a multiple of 64 long.
+    size_t score = _blocks * word_bits;
+    Word last_positive = ~Word(0);
+    Word last_negative = 0;
+
+    if(_blocks == 1) {
+      for(size_t j = 0; j < text.size(); ++j) {
+        score += advance(last_positive, last_negative, match(text[j])[0], 1);
+        if(row)
+          row[j] = bottom(score, last_positive, last_negative);
+      }
+    }
+    else {
+      std::vector<Word> positive(_blocks, ~Word(0));
+      std::vector<Word> negative(_blocks, 0);
+      for(size_t j = 0; j < text.size(); ++j) {
+        const Word * const equal = match(text[j]);
+        int carry = 1;
+        for(size_t b = 0; b < _blocks; ++b) {
+          carry = advance(positive[b], negative[b], equal[b], carry);
+        }
+        score += carry;
+        if(row)
+          row[j] = bottom(score, positive.back(), negative.back());
+      }
+      last_positive = positive.back();
+      last_negative = negative.back();
+    }
+
+    return bottom(score, last_positive, last_negative);
+  }
+
+  /**
+     \param score the bottom cell of the last block.
+     \param positive which of the last block's cells are one more than the
+     ones above them.
+     \param negative which are one less.
+     \return the cell in the pattern's last row, stepping back up past
+     whatever of the block runs off the end of the pattern.
+  */
+  size_t bottom(const size_t score,
+                const Word positive,
+                const Word negative) const
+  {
+    return score - __builtin_popcountll(positive & _past_end) +
+        __builtin_popcountll(negative & _past_end);
+  }
+
+  /**
+     \return a bit vector per block with a bit set for every character of the
+     pattern that's `character`.
+  */
+  const Word * match(const char character) const
+  {
+    return &_matches[_symbols[static_cast<unsigned char>(character)] *
+                     _blocks];
+  }
+
+  std::string _pattern;
+  size_t _blocks;
+
+  // The rows of the last block past the end of the pattern.
+  Word _past_end;
+
+  std::vector<size_t> _symbols;
+  std::vector<Word> _matches;
+};
+
+/**
+   \param lhs the string to edit.
+   \param rhs what to edit it into.
+   \return how few insertions, deletions and substitutions turn `lhs` into
+   `rhs`.
+
+   Makes a Pattern of the shorter string and measures the longer against it,
+   for O(|lhs||rhs|/64) time, and memory for a bit per character of the
+   shorter string for each different character in it.
+*/
+inline size_t distance(const std::string & lhs, const std::string & rhs)
+{
+  if(lhs.size() < rhs.size())
+    return Pattern(lhs).distance(rhs);
+  return Pattern(rhs).distance(lhs);
+}
+
+/**
+   \param lhs the string to edit.
+   \param rhs what to edit it into.
+   \param costs what each kind of edit costs.
+   \param distances resized to |rhs| + 1, with element `j` set to the
+   cheapest way of turning `lhs` into the first `j` characters of `rhs`: the
+   table's last row.
+
+   With every edit costing one, that's a Pattern of `lhs`; otherwise it's
+   strips.
+*/
+inline void last_row(const std::string & lhs,
+                     const std::string & rhs,
+                     const Costs & costs,
+                     std::vector<size_t> & distances)
+{
+  if(costs.insertion == 1 && costs.deletion == 1 && costs.substitution == 1)
+  {
+    Pattern(lhs).last_row(rhs, distances);
+    return;
+  }
+  distances.resize(rhs.size() + 1);
+  distances[0] = lhs.size() * costs.deletion;
+  strips(lhs, rhs, costs, &distances[0] + 1);
+}
+
+/**
+   \param lhs the string to edit.
+   \param rhs what to edit it into.
+   \param k the largest distance that matters.
+   \return the distance between `lhs` and `rhs` if it's at most `k`, or `k + 1`
+   if it's any more.
+
+   Only cells within `k` of the table's diagonal can be on a path that costs
+   `k` or less, so this keeps just those 2k + 1 of each row, for O(k) memory
+   and O(k min(|lhs|,|rhs|)) time. It stops as soon as every cell in a row,
+   plus the difference in what's left of each string after it, is more than
+   `k`, and straight away if the strings' lengths are more than `k` apart.
+   When `k` is big enough that the band is wider than the bit vectors, it's
+   `distance(lhs, rhs)` instead.
+*/
+inline size_t bounded_distance(const std::string & lhs,
+                               const std::string & rhs,
+                               const size_t k)
+{
+  const std::string & rows = lhs.size() < rhs.size() ? lhs : rhs;
+  const std::string & columns = lhs.size() < rhs.size() ? rhs : lhs;
+
+  // No distance is more than the longer string's length, so any `k` from
+  // there up would just mean the whole table, and `k + 1` could wrap.
+  if(k >= columns.size())
+    return distance(lhs, rhs);
+  if(columns.size() - rows.size() > k)
+    return k + 1;
+
+  // A cell of the band costs about two thirds of what a 64 row block of the
+  // bit vectors does, so once the band's wider than one and a half blocks a
+  // row, the bit vectors are quicker even without stopping early.
+  const size_t blocks = (rows.size() + 63) / 64;
+  if(2 * k + 1 >= blocks + blocks / 2)
+    return std::min(distance(lhs, rhs), k + 1);
+
+  // band[d] is the cell in column i + d - k of row i; anything off the table,
+  // or more than k, is k + 1.
+  const size_t width = 2 * k + 1;
+  const size_t over = k + 1;
+  std::vector<size_t> band(width + 1, over);
+  for(size_t d = k; d < width; ++d)
+    band[d] = d - k;
+
+  for(size_t i = 1; i <= rows.size(); ++i) {
+    const char character = rows[i - 1];
+    const size_t remaining = rows.size() - i;
+    size_t best = over;
+    size_t left = over;
+    for(size_t d = 0; d < width; ++d) {
+      // Column j = i + d - k, skipping columns off either end of the table.
+      if(i + d < k || i + d - k > columns.size()) {
+        band[d] = left = over;
+        continue;
+      }
+      const size_t j = i + d - k;
+
+      size_t cell = std::min(i, over);
+      if(j) {
+        cell = band[d] + (character == columns[j - 1] ? 0 : 1);
+        cell = std::min(cell, band[d + 1] + 1);
+        cell = std::min(cell, left + 1);
+        cell = std::min(cell, over);
+      }
+      band[d] = left = cell;
+
+      // However the rest goes, it has to make up the difference in length.
+      const size_t rest = columns.size() - j;
+      const size_t gap = rest > remaining ? rest - remaining : remaining - rest;
+      best = std::min(best, cell + gap);
+    }
+    if(best > k)
+      return over;
+  }
+
+  return band[columns.size() - rows.size() + k];
+}
+
+}
+
+#endif
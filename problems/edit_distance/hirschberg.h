@@ -0,0 +1,130 @@
+#ifndef HIRSCHBERG_H
+#define HIRSCHBERG_H
+
+// STL
+#include <string>
+#include <vector>
+
+// boost
+#include <boost/bind/bind.hpp>
+#include <boost/thread.hpp>
+
+/**
+   Hirschberg's divide and conquer, for any table filled in from its top left
+   corner one row at a time, where a cell's score comes from the three next to
+   it above and to the left: edit distance, where the best is least, and the
+   longest common subsequence, where it's most.
+
+   It never keeps more than two rows of the table. The top half of `lhs` is
+   scored against every prefix of `rhs`, and the bottom half against every
+   suffix, by working out just the last row of each; wherever the two add up
+   to best is where the best path crosses the middle of `lhs`, and the pieces
+   either side of it are independent, so they're solved the same way, on
+   threads of their own while there are threads to spare. Once a piece is
+   small enough, its whole table is filled in and walked back from the corner
+   instead.
+*/
+namespace edit {
+
+/**
+   A piece small enough to fill in the whole table for: (|lhs|+1)x(|rhs|+1)
+   cells no more than this.
+*/
+const size_t traceback_cells = 1 << 16;
+
+/**
+   A piece big enough to be worth a thread: |lhs||rhs| at least this.
+*/
+const size_t parallel_cells = 1 << 20;
+
+/**
+   \param lhs the strings down the side of the table.
+   \param rhs the string across the top.
+   \param last_row called as `last_row(lhs, rhs, row)` to resize `row` to
+   |rhs| + 1 and fill it with the table's last row.
+   \param traceback called as `traceback(lhs, rhs, output)` to add the best
+   path through a whole table to `output`.
+   \param better `better(a, b)` is true if score `a` is better than `b`:
+   `std::less<size_t>()` for a cost, `std::greater<size_t>()` for a length.
+   \param threads how many threads this piece may use.
+   \param output where to add the best path, in order. Output is a std::string
+   or a std::vector, or anything else with `insert()` and iterators.
+*/
+template <typename LastRow, typename Traceback, typename Better,
+          typename Output>
+void hirschberg(const std::string & lhs,
+                const std::string & rhs,
+                const LastRow last_row,
+                const Traceback traceback,
+                const Better better,
+                const unsigned int threads,
+                Output & output)
+{
+  if(lhs.size() < 2 || (lhs.size() + 1) * (rhs.size() + 1) <= traceback_cells)
+  {
+    traceback(lhs, rhs, output);
+    return;
+  }
+
+  const bool parallel =
+      threads > 1 && lhs.size() * rhs.size() >= parallel_cells;
+  const size_t middle = lhs.size() / 2;
+  const std::string top(lhs, 0, middle);
+  const std::string bottom(lhs, middle);
+
+  // The bottom half's scores come from running both strings backwards.
+  size_t split = 0;
+  {
+    std::vector<size_t> forward;
+    std::vector<size_t> backward;
+    const std::string bottom_reversed(bottom.rbegin(), bottom.rend());
+    const std::string rhs_reversed(rhs.rbegin(), rhs.rend());
+    if(parallel) {
+      boost::thread other(boost::bind<void>(last_row,
+                                            boost::cref(top),
+                                            boost::cref(rhs),
+                                            boost::ref(forward)));
+      last_row(bottom_reversed, rhs_reversed, backward);
+      other.join();
+    }
+    else {
+      last_row(top, rhs, forward);
+      last_row(bottom_reversed, rhs_reversed, backward);
+    }
+
+    for(size_t j = 1; j <= rhs.size(); ++j) {
+      if(better(forward[j] + backward[rhs.size() - j],
+                forward[split] + backward[rhs.size() - split]))
+      {
+        split = j;
+      }
+    }
+  }
+
+  const std::string left(rhs, 0, split);
+  const std::string right(rhs, split);
+  if(parallel) {
+    Output later;
+    boost::thread other(
+        boost::bind(&hirschberg<LastRow, Traceback, Better, Output>,
+                    boost::cref(bottom),
+                    boost::cref(right),
+                    last_row,
+                    traceback,
+                    better,
+                    threads / 2,
+                    boost::ref(later)));
+    hirschberg(top, left, last_row, traceback, better,
+               threads - threads / 2, output);
+    other.join();
+    output.insert(output.end(), later.begin(), later.end());
+  }
+  else {
+    hirschberg(top, left, last_row, traceback, better, 1, output);
+    hirschberg(bottom, right, last_row, traceback, better, 1, output);
+  }
+}
+
+}
+
+#endif
@@ -0,0 +1,372 @@
+#ifndef LEXICON_H
+#define LEXICON_H
+
+// Project
+#include "edit_distance.h"
+
+// STL
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+// boost
+#include <boost/bind/bind.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+
+namespace edit {
+
+/**
+   How many characters of each kind a query has, for a quick lower bound on
+   its distance from another string without working the distance out.
+
+   `lower_bound()` counts in place and then puts everything back, so each
+   thread needs a Histogram of its own.
+*/
+class Histogram {
+  public:
+  explicit Histogram(const std::string & query)
+      : _size(query.size()), _counts(256, 0)
+  {
+    for(size_t i = 0; i < query.size(); ++i)
+      ++_counts[static_cast<unsigned char>(query[i])];
+  }
+
+  /**
+     \param other the string to compare the query with.
+     \return no more than the distance between the query and `other`.
+
+     Every character of `other` the query doesn't have enough of takes an
+     insertion or a substitution, and every one of the query's that `other`
+     doesn't have enough of takes a deletion or a substitution, so the
+     distance is at least the larger of the two.
+  */
+  size_t lower_bound(const std::string & other)
+  {
+    size_t extra = 0;
+    for(size_t i = 0; i < other.size(); ++i) {
+      if(--_counts[static_cast<unsigned char>(other[i])] < 0)
+        ++extra;
+    }
+    for(size_t i = 0; i < other.size(); ++i)
+      ++_counts[static_cast<unsigned char>(other[i])];
+
+    const size_t shared = other.size() - extra;
+    return std::max(extra, _size - shared);
+  }
+
+  private:
+  size_t _size;
+  std::vector<long> _counts;
+};
+
+/**
+   A word of a Lexicon near a query, and how near.
+*/
+struct Match {
+  Match(const size_t word = 0, const size_t distance = 0)
+      : word(word), distance(distance)
+  {}
+
+  bool operator<(const Match & other) const
+  {
+    if(distance != other.distance)
+      return distance < other.distance;
+    return word < other.word;
+  }
+
+  /**
+     The word's position in the list the Lexicon was made from.
+  */
+  size_t word;
+
+  /**
+     Its edit distance from the query.
+  */
+  size_t distance;
+};
+
+/**
+   A list of words, indexed to find every one within some edit distance of a
+   query without measuring the query against them all.
+
+   The index is a BK-tree: each word hangs off the first word on the way down
+   from the root it's a distance from that no other child is, labelled with
+   that distance. By the triangle inequality, a word within `k` of the query
+   can only be under a child whose label is within `k` of the query's distance
+   from its parent, so a search only goes down those. Each node also knows the
+   shortest and longest words under it, and a subtree with none near enough
+   the query's length is skipped whole. Before a word's distance is measured,
+   the difference in length and in character counts says how near it can
+   possibly be, and if that's too far for it or for anything under it, it's
+   skipped without measuring.
+
+   The tree is laid out breadth first in one vector, with every node's
+   children next to one another in order of their labels, so a search finds
+   the ones it needs by binary search.
+*/
+class Lexicon : boost::noncopyable {
+  public:
+  /**
+     \param words the words to index. Building the index measures each one
+     against as many words as the tree is deep.
+  */
+  explicit Lexicon(const std::vector<std::string> & words)
+      : _words(words)
+  {
+    if(_words.empty())
+      return;
+
+    // children[word] is the label and word of each of word's children.
+    std::vector<std::vector<std::pair<size_t, size_t> > >
+        children(_words.size());
+    for(size_t word = 1; word < _words.size(); ++word) {
+      const Pattern pattern(_words[word]);
+      size_t parent = 0;
+      while(true) {
+        const size_t label = pattern.distance(_words[parent]);
+        std::vector<std::pair<size_t, size_t> > & siblings = children[parent];
+        size_t sibling = 0;
+        while(sibling < siblings.size() && siblings[sibling].first != label)
+          ++sibling;
+        if(sibling == siblings.size()) {
+          siblings.push_back(std::make_pair(label, word));
+          break;
+        }
+        parent = siblings[sibling].second;
+      }
+    }
+
+    _nodes.reserve(_words.size());
+    _nodes.push_back(Node(0, 0));
+    for(size_t next = 0; next < _nodes.size(); ++next) {
+      std::vector<std::pair<size_t, size_t> > & below =
+          children[_nodes[next].word];
+      std::sort(below.begin(), below.end());
+
+      _nodes[next].first_child = _nodes.size();
+      _nodes[next].children = below.size();
+      _nodes[next].reach = below.empty() ? 0 : below.back().first;
+      for(size_t child = 0; child < below.size(); ++child)
+        _nodes.push_back(Node(below[child].second, below[child].first));
+      std::vector<std::pair<size_t, size_t> >().swap(below);
+    }
+
+    // Children always come after their parents, so working backwards sees
+    // every subtree before the node it hangs off.
+    for(size_t node = _nodes.size(); node-- > 0;) {
+      Node & here = _nodes[node];
+      here.shortest = here.longest = _words[here.word].size();
+      for(size_t child = 0; child < here.children; ++child) {
+        const Node & below = _nodes[here.first_child + child];
+        here.shortest = std::min(here.shortest, below.shortest);
+        here.longest = std::max(here.longest, below.longest);
+      }
+    }
+  }
+
+  size_t size() const
+  {
+    return _words.size();
+  }
+
+  const std::string & operator[](const size_t word) const
+  {
+    return _words[word];
+  }
+
+  /**
+     \param query the string to look for words near.
+     \param k the furthest a word may be from `query`.
+     \param threads how many threads to search with.
+     \return every word within `k` of `query`, nearest first.
+
+     The top of the tree is searched breadth first until there are plenty of
+     subtrees for every thread, and then each thread takes the next subtree
+     nobody has searched yet, as soon as it finishes the last, so a few big
+     subtrees don't hold everyone up.
+  */
+  std::vector<Match> search(const std::string & query,
+                            const size_t k,
+                            const unsigned int threads = 1) const
+  {
+    Search search(query, k);
+    if(_nodes.empty())
+      return search.found;
+
+    const size_t workers = std::max(threads, 1u);
+    const size_t subtrees_per_worker = 64;
+    {
+      Histogram histogram(query);
+      search.subtrees.push_back(0);
+      while(!search.subtrees.empty() &&
+            search.subtrees.size() < workers * subtrees_per_worker)
+      {
+        const size_t node = search.subtrees.front();
+        search.subtrees.pop_front();
+        visit(search, histogram, node, search.found, search.subtrees);
+      }
+    }
+
+    boost::thread_group group;
+    for(size_t worker = 0; worker < workers; ++worker) {
+      group.create_thread(
+          boost::bind(&Lexicon::work, this, boost::ref(search)));
+    }
+    group.join_all();
+
+    std::sort(search.found.begin(), search.found.end());
+    return search.found;
+  }
+
+  private:
+  struct Node {
+    Node(const size_t word, const size_t label)
+        : word(word), label(label), first_child(0), children(0), reach(0),
+          shortest(0), longest(0)
+    {}
+
+    /**
+       Which of the words this is.
+    */
+    size_t word;
+
+    /**
+       Its distance from its parent.
+    */
+    size_t label;
+
+    /**
+       Where its children start in `_nodes`, and how many there are.
+    */
+    size_t first_child;
+    size_t children;
+
+    /**
+       Its children's biggest label: a query can only find anything under
+       this node if it's within that, plus `k`, of it.
+    */
+    size_t reach;
+
+    /**
+       The lengths of the shortest and longest words in its subtree, itself
+       included: nothing in it is nearer a query than the difference in
+       length.
+    */
+    size_t shortest;
+    size_t longest;
+  };
+
+  /**
+     Orders nodes by their labels, for finding a range of children.
+  */
+  struct LabelLess {
+    bool operator()(const Node & node, const size_t label) const
+    {
+      return node.label < label;
+    }
+  };
+
+  /**
+     One query's search, shared by every thread.
+  */
+  struct Search {
+    Search(const std::string & query, const size_t k)
+        : query(query), pattern(query), k(k)
+    {}
+
+    const std::string & query;
+    const Pattern pattern;
+    const size_t k;
+
+    boost::mutex mutex;
+    std::deque<size_t> subtrees;
+    std::vector<Match> found;
+  };
+
+  /**
+     \param search the search being worked on.
+     \param histogram the query's, for this thread alone.
+     \param node the node to look at.
+     \param found where to add its word if it's near enough.
+     \param next where to add whichever of its children might have anything
+     near enough under them.
+  */
+  template <class Nodes>
+  void visit(const Search & search,
+             Histogram & histogram,
+             const size_t node,
+             std::vector<Match> & found,
+             Nodes & next) const
+  {
+    const Node & here = _nodes[node];
+    const size_t length = search.query.size();
+    if(length + search.k < here.shortest || here.longest + search.k < length)
+      return;
+
+    const std::string & word = _words[here.word];
+    const size_t furthest = here.reach + search.k;
+
+    const size_t lengths = word.size() > length ?
+        word.size() - length : length - word.size();
+    if(lengths > furthest || histogram.lower_bound(word) > furthest)
+      return;
+
+    const size_t distance = search.pattern.distance(word);
+    if(distance <= search.k)
+      found.push_back(Match(here.word, distance));
+    if(!here.children)
+      return;
+
+    const Node * const first = &_nodes[here.first_child];
+    const Node * const last = first + here.children;
+    const Node * child = std::lower_bound(
+        first,
+        last,
+        distance > search.k ? distance - search.k : 0,
+        LabelLess());
+    for(; child != last && child->label <= distance + search.k; ++child)
+      next.push_back(child - &_nodes[0]);
+  }
+
+  /**
+     \param search the search being worked on.
+
+     The body of each worker thread: takes the next subtree nobody has
+     searched yet, and searches it depth first, until there are none left.
+  */
+  void work(Search & search) const
+  {
+    Histogram histogram(search.query);
+    std::vector<Match> found;
+    std::vector<size_t> stack;
+    while(true)
+    {
+      {
+        boost::lock_guard<boost::mutex> lock(search.mutex);
+        if(search.subtrees.empty())
+          break;
+        stack.push_back(search.subtrees.front());
+        search.subtrees.pop_front();
+      }
+
+      while(!stack.empty()) {
+        const size_t node = stack.back();
+        stack.pop_back();
+        visit(search, histogram, node, found, stack);
+      }
+    }
+
+    boost::lock_guard<boost::mutex> lock(search.mutex);
+    search.found.insert(search.found.end(), found.begin(), found.end());
+  }
+
+  std::vector<std::string> _words;
+  std::vector<Node> _nodes;
+};
+
+}
+
+#endif
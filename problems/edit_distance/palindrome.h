@@ -0,0 +1,247 @@
+#ifndef PALINDROME_H
+#define PALINDROME_H
+
+// STL
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+   Whether a string is a k-palindrome: whether taking at most `k` characters
+   out of it leaves a palindrome.
+
+   That's whether some split of the string into a front and a back, maybe
+   with one character left over in the middle, has a front that takes at most
+   `k` insertions and deletions, between them, to turn into the back
+   reversed. So it's the edit distance, without substitutions, between the
+   string and itself reversed, only worked out until the two meet in the
+   middle: half the table.
+
+   And only a sliver of that. A cell `d` off the diagonal is `d` edits from
+   the top left corner at least, and `d` more from any split, so only the
+   2k + 1 diagonals within `k` of the main one matter, and any cell worth more
+   than `k` is as good as infinite. That's O(nk) time and O(k) memory, and as
+   soon as a whole row is more than `k` there's no point going on.
+
+   Each row of the table takes the next character from the front of the
+   string and the next from the back, so the string doesn't have to be in
+   memory at all: `is_k_palindrome_file()` reads a file from both ends at
+   once, a buffer at a time.
+*/
+namespace edit {
+
+/**
+   How much of a file FileReader reads at once.
+*/
+const size_t file_buffer_bytes = 1024 * 1024;
+
+/**
+   Hands out a string's characters from the front, or from the back.
+*/
+class StringReader {
+  public:
+  StringReader(const std::string & text, const bool backwards)
+      : _text(text), _backwards(backwards),
+        _position(backwards ? text.size() : 0)
+  {}
+
+  char next()
+  {
+    return _backwards ? _text[--_position] : _text[_position++];
+  }
+
+  private:
+  const std::string & _text;
+  const bool _backwards;
+  size_t _position;
+};
+
+/**
+   Hands out a file's bytes from the front, or from the back, a buffer at a
+   time.
+*/
+class FileReader {
+  public:
+  /**
+     \param filename the file to read.
+     \param length how many bytes of it to hand out, from the front.
+     \param backwards whether to start with byte `length - 1` and work down,
+     rather than at 0 and work up.
+  */
+  FileReader(const std::string & filename,
+             const size_t length,
+             const bool backwards)
+      : _file(filename.c_str(), std::ios::in | std::ios::binary),
+        _filename(filename),
+        _backwards(backwards),
+        _remaining(length),
+        _buffer(std::min(length, file_buffer_bytes)),
+        _used(0),
+        _filled(0)
+  {
+    if(!_file)
+      throw std::runtime_error("Couldn't open " + filename);
+  }
+
+  char next()
+  {
+    if(_used == _filled)
+      fill();
+    const size_t at = _used++;
+    return _buffer[_backwards ? _filled - 1 - at : at];
+  }
+
+  private:
+  void fill()
+  {
+    _filled = std::min(_remaining, _buffer.size());
+    if(_backwards)
+      _file.seekg(_remaining - _filled);
+    _file.read(&_buffer[0], _filled);
+    if(!_file)
+      throw std::runtime_error("Couldn't read " + _filename);
+    _remaining -= _filled;
+    _used = 0;
+  }
+
+  std::ifstream _file;
+  const std::string _filename;
+  const bool _backwards;
+
+  // How many bytes haven't been read into the buffer yet.
+  size_t _remaining;
+
+  std::vector<char> _buffer;
+  size_t _used;
+  size_t _filled;
+};
+
+/**
+   \param front the string's characters from the front.
+   \param back its characters from the back.
+   \param length how long it is.
+   \param k how many characters may be taken out.
+   \return whether taking at most `k` characters out of the string leaves a
+   palindrome.
+
+   Row `i` of the table is the first `i` characters, and column `j` the last
+   `j` reversed; `band[d]` is column `i + d - k` of the row being worked on,
+   worth `k + 1` if it's off the table or worth more than `k`. Each row takes
+   one character from `front`, and one from `back` for the right hand end of
+   the band, remembered in `reversed` until it's fallen off the left.
+*/
+template <class Front, class Back>
+bool is_k_palindrome(Front & front,
+                     Back & back,
+                     const size_t length,
+                     const size_t k)
+{
+  // Taking out all but one character leaves a palindrome, so there's nothing
+  // to work out, and no band as wide as a huge `k` to make room for.
+  if(length <= 1 || k >= length - 1)
+    return true;
+
+  const size_t width = 2 * k + 1;
+  const size_t over = k + 1;
+
+  // reversed[j % width] is the character j from the back.
+  std::vector<char> reversed(width);
+  size_t pulled = 0;
+
+  std::vector<size_t> band(width + 1, over);
+  for(size_t d = k; d < width; ++d)
+    band[d] = d - k;
+
+  // Rows past the middle, plus k, can't meet the band at any split.
+  const size_t last_row = std::min(length, (length + k) / 2);
+  for(size_t i = 0; i <= last_row; ++i) {
+    size_t best = i ? over : 0;
+    if(i) {
+      const char character = front.next();
+      for(; pulled < std::min(i + k, length); ++pulled)
+        reversed[pulled % width] = back.next();
+
+      size_t left = over;
+      for(size_t d = 0; d < width; ++d) {
+        if(i + d < k || i + d - k > length) {
+          band[d] = left = over;
+          continue;
+        }
+        const size_t j = i + d - k;
+
+        size_t cell = std::min(i, over);
+        if(j) {
+          if(character == reversed[(j - 1) % width])
+            cell = band[d];
+          else
+            cell = std::min(std::min(band[d + 1], left) + 1, over);
+        }
+        band[d] = left = cell;
+        best = std::min(best, cell);
+      }
+    }
+
+    // Splitting after character i, with or without one more in the middle.
+    for(size_t middle = 0; middle < 2; ++middle) {
+      if(i + middle > length)
+        continue;
+      const size_t j = length - i - middle;
+      if(j + k >= i && j <= i + k && band[j + k - i] <= k)
+        return true;
+    }
+
+    if(best > k)
+      return false;
+  }
+  return false;
+}
+
+/**
+   \param word the string to check.
+   \param k how many characters may be taken out.
+   \return whether taking at most `k` characters out of `word` leaves a
+   palindrome.
+*/
+inline bool is_k_palindrome(const std::string & word, const size_t k)
+{
+  StringReader front(word, false);
+  StringReader back(word, true);
+  return is_k_palindrome(front, back, word.size(), k);
+}
+
+/**
+   \param filename the file to check, all but a newline at the very end.
+   \param k how many bytes may be taken out.
+   \return whether taking at most `k` bytes out of the file leaves a
+   palindrome.
+
+   Reads the file from both ends, a megabyte at a time, so it needs those two
+   megabytes and O(k) more whatever the size of the file, and only reads up to
+   `k` bytes past the middle from either end.
+*/
+inline bool is_k_palindrome_file(const std::string & filename, const size_t k)
+{
+  std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+  if(!file)
+    throw std::runtime_error("Couldn't open " + filename);
+  file.seekg(0, std::ios::end);
+  size_t length = static_cast<size_t>(file.tellg());
+  if(length) {
+    char last;
+    file.seekg(length - 1);
+    if(!file.get(last))
+      throw std::runtime_error("Couldn't read " + filename);
+    if(last == '\n')
+      --length;
+  }
+
+  FileReader front(filename, length, false);
+  FileReader back(filename, length, true);
+  return is_k_palindrome(front, back, length, k);
+}
+
+}
+
+#endif
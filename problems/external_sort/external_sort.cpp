@@ -1,17 +1,31 @@
+#include "external_sort.h"
+
 #include <iostream>
 #include <fstream>
 #include <vector>
 #include <string>
 #include <stdexcept>
+#include <iomanip>
+#include <algorithm>
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/foreach.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/program_options.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <queue>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace std;
 using namespace boost;
+using namespace external;
 
 /**
-   Kind of a gross implementation, but I wanted to see if I could figure this 
+   Kind of a gross implementation, but I wanted to see if I could figure this
    out. The question goes, "Given a small amount of memory and a large amount of
    data on disk (i.e. more data than can fit in memory at any one time) find the
    duplicates within the data.
@@ -19,13 +33,38 @@ using namespace boost;
    In this case, I've made the assumption that the data on disk are ints written
    to a file.
 
-   The solution below loads the data into memory in small chunks, sorts 
+   The solution below loads the data into memory in small chunks, sorts
    those small chunks and then writes them back to disk to temporary files.
 
    Once all the data has been sorted into temporary files, we merge pairs
-   of the smaller file into single, larger files. Once we've done this merge 
-   across all small files, we're left with one single large sorted file, in 
+   of the smaller file into single, larger files. Once we've done this merge
+   across all small files, we're left with one single large sorted file, in
    which duplicate data entries are next to one another.
+
+   That's still there, as `--pairwise`, but by default it's done a little less
+   grossly, by the sort in external_sort.h, which works on any kind of record
+   and is all this file's really a front end for. The sorted temporary files,
+   or runs, are made by radix sorting as much as fits in memory at a time,
+   split between `--threads` workers, and kept in a directory of their own
+   inside `--temp_directory`. Then all of the runs are merged at once, through
+   a heap, so every item is read and written once more rather than once for
+   each round of pairing up files.
+
+   Only the file being sorted is text. The runs are the ints' raw bytes, read
+   and written a megabyte at a time straight through `read()` and `write()`, so
+   nothing gets parsed or formatted more than once and there's no flushing on
+   every line. With `--io_threads`, each of those megabytes is read ahead, or
+   written behind, by a few threads on the side while the next one is merged,
+   so the merge and the disk aren't forever waiting on each other.
+   `--benchmark` times that against the pairwise merge. With `--lines`, it's
+   lines of text that get sorted instead. And with `--resume_directory`, a
+   sort that dies can be run again and pick up where it left off.
+
+   And if it's really the duplicates you're after, `--report_duplicates` picks
+   them out as the last merge goes by, without writing the sorted file at all.
+   With `--hash_partition` it doesn't even sort the whole file; each int is
+   hashed into one of a few partitions, so every copy of it lands in the same
+   one, and each partition is sorted in memory on its own.
 */
 
 
@@ -33,23 +72,23 @@ void getline(ifstream && input, string & output)
 {
   getline(input,output);
   boost::trim(output);
-} 
+}
 
 /**
-   Assumes files are named 1, 2, 3... `flushed_file_count`, merges said files,
-   and then writes the final file back to `filename`.
+   Merges the files named in `runs` two at a time, and then writes the final
+   file back to `filename`.
  */
-void merge_files(const int flushed_file_count, const string & filename)
+void merge_files(const vector<string> & runs, const string & filename)
 {
   // Figure out initial set of files to merge and put their names in a queue.
   queue<string> files_to_merge;
-  for(int i = 1; i <= flushed_file_count; ++i)
-    files_to_merge.push(lexical_cast<string>(i));
+  for(size_t i = 0; i < runs.size(); ++i)
+    files_to_merge.push(runs[i]);
 
   int count_to_merge = 0; // Count to determine the name of the new files.
 
   // While the queue still has items to merge in it...
-  while(files_to_merge.size() > 1) 
+  while(files_to_merge.size() > 1)
   {
     // Get the two files to merge off the queue.
     const string file_1_filename = files_to_merge.front();
@@ -60,7 +99,7 @@ void merge_files(const int flushed_file_count, const string & filename)
     files_to_merge.pop();
 
     // Create a new file to merge the two into
-    const string merge_filename = 
+    const string merge_filename =
         "merge_" + lexical_cast<string>(++count_to_merge);
     ofstream merge(merge_filename.c_str());
 
@@ -73,7 +112,7 @@ void merge_files(const int flushed_file_count, const string & filename)
     while(!line_1.empty() && !line_2.empty())
     {
       const int
-          line_1_int = lexical_cast<int>(line_1), 
+          line_1_int = lexical_cast<int>(line_1),
           line_2_int = lexical_cast<int>(line_2);
 
       if(line_1_int < line_2_int) {
@@ -111,10 +150,197 @@ void merge_files(const int flushed_file_count, const string & filename)
   }
 
   // Rename the final merge to the name of the original file.
-  rename(files_to_merge.front().c_str(), filename.c_str());
+  if(files_to_merge.empty())
+    ofstream(filename.c_str(), ios::trunc);
+  else
+    rename(files_to_merge.front().c_str(), filename.c_str());
 }
 
 
+/**
+   Reads whitespace separated ints out of a text file, without going through
+   a stream or a `lexical_cast` for every one.
+*/
+class TextReader : public BufferedReader {
+  public:
+  TextReader(const string & filename,
+             IoPool * pool = NULL,
+             const size_t buffer_bytes = io_buffer_bytes)
+      : BufferedReader(filename, pool, buffer_bytes)
+  {}
+
+  bool read(int & item)
+  {
+    // Skip to the start of the next number.
+    while(true)
+    {
+      while(_position < _size && isspace((unsigned char)_buffer[_position]))
+        ++_position;
+      if(_position < _size)
+        break;
+      if(!refill())
+        return false;
+    }
+
+    // A number can have any number of leading zeros, so it can run off the
+    // end of the buffer. Whenever it does, the buffer is refilled, and only
+    // what it's worth so far is kept, along with the start of it in case it
+    // turns out not to be an int.
+    const size_t longest_shown = 64;
+    string shown;
+    size_t start = _position;
+    const bool negative = _buffer[_position] == '-';
+    if(_buffer[_position] == '-' || _buffer[_position] == '+')
+      ++_position;
+
+    bool valid = true;
+    bool any = false;
+    size_t significant = 0;
+    int64_t value = 0;
+    while(true)
+    {
+      if(_position == _size) {
+        if(shown.size() < longest_shown) {
+          shown.append(_buffer + start,
+                       min(_size - start, longest_shown - shown.size()));
+        }
+        if(!refill())
+          break;
+        start = _position;
+        continue;
+      }
+
+      const char character = _buffer[_position];
+      if(isspace((unsigned char)character))
+        break;
+      if(character < '0' || character > '9') {
+        valid = false;
+        break;
+      }
+      ++_position;
+      any = true;
+
+      // Leading zeros don't count towards how many digits an int can have.
+      if(!value && character == '0')
+        continue;
+      if(++significant > 10) {
+        valid = false;
+        break;
+      }
+      value = value * 10 + (character - '0');
+    }
+    if(negative)
+      value = -value;
+
+    if(!valid || !any || value < INT32_MIN || value > INT32_MAX) {
+      size_t token_end = _position;
+      while(token_end < _size && !isspace((unsigned char)_buffer[token_end]))
+        ++token_end;
+      if(shown.size() < longest_shown) {
+        shown.append(_buffer + start,
+                     min(token_end - start, longest_shown - shown.size()));
+      }
+      throw runtime_error("Not an int: " + shown + "; ");
+    }
+
+    item = value;
+    return true;
+  }
+};
+
+/**
+   Writes ints to a text file, one per line.
+*/
+class TextWriter : public BufferedWriter {
+  public:
+  TextWriter(const string & filename,
+             IoPool * pool = NULL,
+             const size_t buffer_bytes = io_buffer_bytes)
+      : BufferedWriter(filename, pool, buffer_bytes)
+  {}
+
+  TextWriter(const string & name,
+             const int descriptor,
+             IoPool * pool = NULL,
+             const size_t buffer_bytes = io_buffer_bytes)
+      : BufferedWriter(name, descriptor, pool, buffer_bytes)
+  {}
+
+  void write(const int item)
+  {
+    format(item, '\n');
+  }
+
+  protected:
+  /**
+     Writes `item` as text, followed by `separator`.
+  */
+  void format(const int64_t item, const char separator)
+  {
+    // The longest number, its sign and a separator.
+    if(_used + 21 > _buffer_bytes)
+      flush();
+
+    char digits[19];
+    size_t count = 0;
+    uint64_t value = item < 0 ? 0u - uint64_t(item) : uint64_t(item);
+    do {
+      digits[count++] = '0' + value % 10;
+      value /= 10;
+    } while(value);
+
+    if(item < 0)
+      _buffer[_used++] = '-';
+    while(count)
+      _buffer[_used++] = digits[--count];
+    _buffer[_used++] = separator;
+  }
+};
+
+/**
+   Takes sorted ints, like any other writer, but rather than write them all
+   out, writes each one that shows up more than once to stdout along with how
+   many times it did: "item count", one per line.
+*/
+class DuplicateWriter : public TextWriter {
+  public:
+  DuplicateWriter(IoPool * pool = NULL,
+                  const size_t buffer_bytes = io_buffer_bytes)
+      : TextWriter("stdout", STDOUT_FILENO, pool, buffer_bytes), _count(0)
+  {}
+
+  void write(const int item)
+  {
+    if(_count && item == _item) {
+      ++_count;
+      return;
+    }
+    report();
+    _item = item;
+    _count = 1;
+  }
+
+  void finish()
+  {
+    report();
+    _count = 0;
+    TextWriter::finish();
+  }
+
+  private:
+  void report()
+  {
+    if(_count < 2)
+      return;
+    format(_item, ' ');
+    format(_count, '\n');
+  }
+
+  int _item;
+  int64_t _count;
+};
+
+
 /**
    Writes the data in `data` to a file on disk named `file_number`.
 */
@@ -122,7 +348,7 @@ void flush_data(const vector<int> &data, const int file_number)
 {
   ofstream file;
   file.open(lexical_cast<string>(file_number).c_str());
- 
+
   for(vector<int>::const_iterator itr = data.begin(); itr != data.end(); ++itr)
   {
     file << *itr << endl;
@@ -135,18 +361,16 @@ void flush_data(const vector<int> &data, const int file_number)
    items in memory. When that happens, we sort, flush the data to disk, and then
    start over (overwriting the old data with the next chunk's.
 
-   After all data has been sorted and written to temporary files, we merge those
-   temporary files into one larger one and then write that file back to the 
-   original location.
+   \return the names of the temporary files written, in order.
 **/
-void external_sort(const string & filename, const int items_per_chunk)
+vector<string> sort_chunks(const string & filename, const int items_per_chunk)
 {
   ifstream file;
   file.open(filename.c_str());
   if(!file.is_open())
     throw runtime_error("Can't open: " + filename + "; ");
 
-  int flushed_file_count = 0;
+  vector<string> runs;
 
   vector<int> data(items_per_chunk);
   vector<int>::iterator data_input_point = data.begin();
@@ -157,16 +381,20 @@ void external_sort(const string & filename, const int items_per_chunk)
     string line;
     getline(file, line);
 
-    if(line.empty())
+    if(line.empty() && !(file.eof() && count))
       continue;
 
-    *data_input_point++ = boost::lexical_cast<int>(line.c_str());
-    ++count;
+    if(!line.empty()) {
+      *data_input_point++ = boost::lexical_cast<int>(line.c_str());
+      ++count;
+    }
 
     if(count >= items_per_chunk || file.eof()){
       data.resize(count);
       sort(data.begin(), data.end());
-      flush_data(data, ++flushed_file_count);
+      runs.push_back(lexical_cast<string>(runs.size() + 1));
+      flush_data(data, runs.size());
+      data.resize(items_per_chunk);
       data_input_point = data.begin();
       count = 0;
     }
@@ -177,15 +405,413 @@ void external_sort(const string & filename, const int items_per_chunk)
     }
   }
 
-  merge_files(flushed_file_count, filename);
+  return runs;
+}
+
+
+/**
+   Moves the finished file at `finished` over the one at `filename`, which
+   until then is left as it was.
+*/
+void replace_file(ScopedFile & finished, const string & filename)
+{
+  if(rename(finished.path().c_str(), filename.c_str()) != 0) {
+    throw runtime_error(
+        "Can't replace: " + filename + "; " + strerror(errno));
+  }
+  finished.keep();
+}
+
+/**
+   \return the name, size and modification time of the file at `filename`, to
+   tell it apart from any other, or how it was before it was changed.
+*/
+string fingerprint(const string & filename)
+{
+  struct stat status;
+  if(stat(filename.c_str(), &status) != 0)
+    throw runtime_error("Can't open: " + filename + "; " + strerror(errno));
+  return filename + " " + lexical_cast<string>(status.st_size) + " " +
+      lexical_cast<string>(status.st_mtime);
+}
+
+/**
+   \return `options` for sorting with `pool` rather than a pool of its own,
+   in what's left of `options.memory` once the input and output have their
+   buffers of `outer_buffer_bytes()`.
+*/
+Options inner_options(const Options & options, IoPool * pool)
+{
+  Options inner = options;
+  inner.pool = pool;
+  inner.memory = sort_memory(options.memory, pool);
+  return inner;
+}
+
+/**
+   Sorts the ints in the file at `filename`, one per line, in place, as
+   `options` says to.
+
+   With `pairwise`, it's done the old way: runs of `items_per_chunk` items,
+   merged two at a time.
+
+   \return how many passes the merge took.
+**/
+size_t sort_file(const string & filename,
+                 const Options & options,
+                 const bool pairwise = false,
+                 const int items_per_chunk = 10)
+{
+  if(pairwise) {
+    const vector<string> runs = sort_chunks(filename, items_per_chunk);
+    merge_files(runs, filename);
+    size_t passes = 0;
+    for(size_t files = runs.size(); files > 1; files = (files + 1) / 2)
+      ++passes;
+    return passes;
+  }
+
+  boost::scoped_ptr<IoPool> pool(make_io_pool(options.io_threads));
+  const size_t outer = outer_buffer_bytes(options.memory, pool.get());
+  ScopedFile sorted(filename + ".sorted");
+  size_t passes;
+  {
+    TextReader input(filename, pool.get(), outer);
+    TextWriter merge(sorted.path(), pool.get(), outer);
+    passes = external_sort<int>(
+        input, merge, inner_options(options, pool.get()));
+  }
+  replace_file(sorted, filename);
+  return passes;
+}
+
+/**
+   Sorts the lines of the file at `filename` in place, byte by byte, as
+   `options` says to.
+*/
+void sort_lines(const string & filename, const Options & options)
+{
+  boost::scoped_ptr<IoPool> pool(make_io_pool(options.io_threads));
+  const size_t outer = outer_buffer_bytes(options.memory, pool.get());
+  ScopedFile sorted(filename + ".sorted");
+  {
+    LineReader input(filename, pool.get(), outer);
+    LineWriter merge(sorted.path(), pool.get(), outer);
+    external_sort<string>(input, merge, inner_options(options, pool.get()));
+  }
+  replace_file(sorted, filename);
+}
+
+
+/**
+   Finds the duplicates in the file at `filename` the same way `sort_file()`
+   sorts it, but rather than write the sorted file, reports each duplicate as
+   the last merge comes across it. The file is left alone.
+*/
+void report_duplicates(const string & filename, const Options & options)
+{
+  boost::scoped_ptr<IoPool> pool(make_io_pool(options.io_threads));
+  const size_t outer = outer_buffer_bytes(options.memory, pool.get());
+  TextReader input(filename, pool.get(), outer);
+  DuplicateWriter duplicates(pool.get(), outer);
+  external_sort<int>(input, duplicates, inner_options(options, pool.get()));
+}
+
+
+/**
+   \return which of `partitions` partitions `item` belongs in.
+*/
+size_t partition(const int item, const size_t partitions)
+{
+  // Fibonacci hashing, so that runs of nearby ints get spread around.
+  return ((uint64_t(uint32_t(item)) * 0x9E3779B97F4A7C15ull) >> 32) %
+      partitions;
+}
+
+/**
+   Finds the duplicates in the file at `filename` without sorting the whole
+   thing: every copy of an int hashes to the same partition, so each
+   partition's duplicates can be found on their own. The partitions are made
+   small enough to sort in memory, all at once, whenever the hash spreads
+   things out evenly enough. Any that still come out too big, say because they
+   hold a million copies of one int, are sorted externally.
+
+   Each duplicate is reported as in `report_duplicates()`, although not in
+   order. The file is left alone.
+*/
+void report_duplicates_by_hash(const string & filename,
+                               const Options & options)
+{
+  boost::scoped_ptr<IoPool> pool(make_io_pool(options.io_threads));
+  const size_t outer = outer_buffer_bytes(options.memory, pool.get());
+  const size_t memory = sort_memory(options.memory, pool.get());
+  TempDirectory temp(options.temp_directory);
+
+  // Partitions too big to sort in memory are sorted externally, but they
+  // aren't what there'd be a manifest for.
+  Options partition_options = inner_options(options, pool.get());
+  partition_options.resume_directory.clear();
+
+  // Ints are shorter in binary than in text, so this many partitions is
+  // usually plenty. There can't be more than we have buffers for, though, and
+  // they share memory between them.
+  TextReader file(filename, pool.get(), outer);
+  const size_t partitions = min<size_t>(
+      file.size() / max<size_t>(memory, 1) + 1, fan_in(memory, pool.get()));
+  const size_t partition_buffer_bytes =
+      buffer_bytes(memory, partitions + 1, pool.get());
+
+  vector<string> names;
+  {
+    boost::ptr_vector<RecordWriter<int> > writers;
+    for(size_t i = 0; i < partitions; ++i)
+    {
+      names.push_back(temp.make("partition"));
+      writers.push_back(new RecordWriter<int>(
+          names.back(), pool.get(), partition_buffer_bytes));
+    }
+
+    int item;
+    while(file.read(item))
+      writers[partition(item, partitions)].write(item);
+
+    for(size_t i = 0; i < partitions; ++i)
+      writers[i].finish();
+  }
+
+  DuplicateWriter duplicates(pool.get(), outer);
+  vector<int> items;
+  BOOST_FOREACH(const string & name, names)
+  {
+    {
+      RecordReader<int> partition(name, pool.get(), outer);
+      if(partition.size() > memory) {
+        external_sort<int>(partition, duplicates, partition_options);
+        remove(name.c_str());
+        continue;
+      }
+
+      items.clear();
+      items.reserve(partition.size() / sizeof(int));
+      int item;
+      while(partition.read(item))
+        items.push_back(item);
+    }
+    remove(name.c_str());
+
+    sort(items.begin(), items.end());
+    BOOST_FOREACH(const int item, items)
+      duplicates.write(item);
+  }
+  duplicates.finish();
+}
+
+
+/**
+   Copies the file at `from` to `to`, byte for byte.
+*/
+void copy_file(const string & from, const string & to)
+{
+  ifstream input(from.c_str(), ios::binary);
+  ofstream output(to.c_str(), ios::binary | ios::trunc);
+  if(!input.is_open() || !output.is_open())
+    throw runtime_error("Can't copy: " + from + "; ");
+  output << input.rdbuf();
+}
+
+/**
+   \return whether the files at `a` and `b` hold exactly the same bytes.
+*/
+bool same_file(const string & a, const string & b)
+{
+  ifstream first(a.c_str(), ios::binary), second(b.c_str(), ios::binary);
+  if(!first.is_open() || !second.is_open())
+    return false;
+
+  vector<char> first_buffer(64 * 1024), second_buffer(64 * 1024);
+  while(first && second)
+  {
+    first.read(&first_buffer[0], first_buffer.size());
+    second.read(&second_buffer[0], second_buffer.size());
+    if(first.gcount() != second.gcount() ||
+       !equal(first_buffer.begin(),
+              first_buffer.begin() + first.gcount(),
+              second_buffer.begin()))
+    {
+      return false;
+    }
+  }
+  return !first && !second;
+}
+
+/**
+   Sorts a copy of the file at `filename` each of three ways, as `options`
+   says to, and prints how long each took to stdout:
+
+   - pairwise, as `merge_files()` always has, but with runs as big as memory
+     rather than 10 items, so it's a fair fight;
+   - with every run merged at once, reading and writing in the foreground;
+   - the same again, with `options.io_threads` threads reading ahead and
+     writing behind.
+
+   The file itself is left alone, and the copies are removed afterwards. Throws
+   if the three don't come out the same.
+*/
+void benchmark(const string & filename, const Options & options)
+{
+  const char * names[] = {"pairwise", "k-way", "pipelined"};
+  const size_t engines = sizeof(names) / sizeof(names[0]);
+  const double megabytes = TextReader(filename).size() / 1048576.0;
+
+  boost::ptr_vector<ScopedFile> copies;
+  for(size_t engine = 0; engine < engines; ++engine)
+  {
+    copies.push_back(new ScopedFile(string("benchmark_") + names[engine]));
+    copy_file(filename, copies.back().path());
+
+    Options engine_options = options;
+    engine_options.io_threads =
+        engine == engines - 1 ? max(options.io_threads, 1u) : 0;
+    engine_options.resume_directory.clear();
+
+    const double start = seconds();
+    const size_t passes = sort_file(
+        copies.back().path(),
+        engine_options,
+        engine == 0,
+        max<size_t>(options.memory / sizeof(int), 1));
+    const double elapsed = seconds() - start;
+
+    cout << setw(10) << left << names[engine] << right << fixed
+         << setprecision(3) << setw(9) << elapsed << " s"
+         << setprecision(1) << setw(9) << megabytes / elapsed << " MB/s"
+         << setw(4) << passes << (passes == 1 ? " pass" : " passes") << endl;
+  }
+
+  bool same = true;
+  for(size_t engine = 1; engine < engines; ++engine)
+    same = same && same_file(copies[0].path(), copies[engine].path());
+  if(!same)
+    throw runtime_error("The sorts of " + filename + " don't agree; ");
 }
 
 
 int main(int argc, char* argv[])
 {
-  // Realize I'm not doing a lot of validation here...
-  if(argc != 2)
-    cerr << "You need to specify a file to sort." << endl;
+  program_options::variables_map option_map;
+  try {
+    program_options::options_description description("External sort options");
+
+    description.add_options()
+        ("help", "produce help message")
+
+        ("memory",
+         program_options::value<size_t>()->default_value(64),
+         "roughly how many megabytes to sort in.")
+
+        ("threads",
+         program_options::value<unsigned int>()->default_value(1),
+         "how many threads to make runs with.")
+
+        ("io_threads",
+         program_options::value<unsigned int>()->default_value(2),
+         "how many threads to read ahead and write behind with while "
+         "merging, or 0 to do it all in the foreground.")
+
+        ("temp_directory",
+         program_options::value<string>()->default_value("."),
+         "where to make a directory to keep the runs in while sorting.")
+
+        ("resume_directory",
+         program_options::value<string>(),
+         "keep the runs in a directory of their own in this one, along with "
+         "a manifest of how far the sort has got, so that if it dies, running "
+         "it again the same way picks up where it left off.")
+
+        ("lines",
+         "sort the lines of the file, byte by byte, rather than ints.")
+
+        ("pairwise",
+         "sort 10 items at a time, and merge the files two at a time, as this "
+         "used to.")
+
+        ("benchmark",
+         "rather than sort the file, time sorting copies of it pairwise, all "
+         "at once, and all at once with --io_threads, and check they agree. "
+         "The file is left alone.")
+
+        ("report_duplicates",
+         "rather than sort the file, print each int that's in it more than "
+         "once, and how many times, to stdout, in order. The file is left "
+         "alone.")
+
+        ("hash_partition",
+         "with --report_duplicates, find them by hashing the ints into "
+         "partitions small enough to sort in memory, rather than sorting the "
+         "whole file. Faster, but the duplicates come out in no particular "
+         "order.")
+
+        ("file",
+         program_options::value<string>(),
+         "the path of the file of ints to sort in place.");
+
+    program_options::positional_options_description positional_arguments;
+    positional_arguments.add("file", 1);
+
+    program_options::store(
+        program_options::command_line_parser(argc, argv)
+        .options(description)
+        .positional(positional_arguments)
+        .run(),
+        option_map);
+
+    if(option_map.count("help")) {
+      cout << description << endl;
+      return 1;
+    }
 
-  external_sort(argv[1], 10);
+    program_options::notify(option_map);
+
+    if(!option_map.count("file"))
+      throw program_options::required_option("file");
+  }
+  catch(const program_options::error & error) {
+    cerr << error.what() << endl;
+    return 1;
+  }
+
+  const string filename = option_map["file"].as<string>();
+  Options options;
+  options.memory = option_map["memory"].as<size_t>() * 1024 * 1024;
+  options.threads = max(option_map["threads"].as<unsigned int>(), 1u);
+  options.io_threads = option_map["io_threads"].as<unsigned int>();
+  options.temp_directory = option_map["temp_directory"].as<string>();
+  try {
+    if(option_map.count("resume_directory")) {
+      options.resume_directory = option_map["resume_directory"].as<string>();
+      options.fingerprint = fingerprint(filename);
+    }
+
+    if(option_map.count("benchmark")) {
+      benchmark(filename, options);
+    }
+    else if(option_map.count("report_duplicates") &&
+            option_map.count("hash_partition"))
+    {
+      report_duplicates_by_hash(filename, options);
+    }
+    else if(option_map.count("report_duplicates")) {
+      report_duplicates(filename, options);
+    }
+    else if(option_map.count("lines")) {
+      sort_lines(filename, options);
+    }
+    else {
+      sort_file(filename, options, option_map.count("pairwise"));
+    }
+  }
+  catch(const std::exception & error) {
+    cerr << error.what() << endl;
+    return -1;
+  }
 }
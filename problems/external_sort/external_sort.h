@@ -0,0 +1,2204 @@
+#ifndef EXTERNAL_SORT_H
+#define EXTERNAL_SORT_H
+
+// STL
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// boost
+#include <boost/array.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/crc.hpp>
+#include <boost/exception_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+// POSIX
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+   Sorts more records than fit in memory, by way of sorted runs on disk.
+
+   Records come from a Reader, anything with a `bool read(Record &)` which
+   returns false once there are no more, and go to a Writer, anything with a
+   `void write(const Record &)` and a `void finish()`. RecordReader and
+   RecordWriter read and write files of fixed-width binary records, such as
+   64-bit keys or structs of them, and LineReader and LineWriter read and write
+   newline-delimited strings, but anything that looks like them will do:
+
+     external::LineReader input("words");
+     external::LineWriter output("sorted_words");
+     external::external_sort<std::string>(input, output);
+
+   Records are ordered by `compare` on whatever `key` gives back for them,
+   `std::less` on the whole record unless told otherwise. When the key is an
+   integer, or a boost::array of unsigned chars, and it's compared with
+   `std::less`, the runs are made by radix sorting as much as fits in memory
+   at a time. Otherwise they're made by replacement selection: a heap as big
+   as memory allows, which keeps writing out the smallest thing it holds that
+   isn't smaller than what it last wrote. On random data that makes runs about
+   twice as long as the heap. Then all of the runs are merged at once, through
+   another heap.
+
+   Runs are the records' raw bytes, or each string's length and then its
+   bytes, read and written up to a megabyte at a time straight through
+   `read()` and `write()`. They're kept in a directory of their own, made inside
+   `Options::temp_directory`, which is cleaned up however the sort ends.
+
+   Or, with `Options::resume_directory`, they're kept in a directory of ours
+   inside that one, which is always the same, along with a Manifest of every
+   run that's finished, and its checksum, so a sort that dies can be picked up
+   again from its last checkpoint or merge rather than from nothing.
+*/
+namespace external {
+
+/**
+   How much of a file is read or written at once, when there's memory for it.
+*/
+const size_t io_buffer_bytes = 1024 * 1024;
+
+/**
+   The least of a file that's read or written at once, however many files
+   there are to share memory between.
+*/
+const size_t min_buffer_bytes = 64 * 1024;
+
+/**
+   Room at the front of a read buffer for whatever was left unread in the last
+   one, when reading ahead. Nothing we read leaves more than this.
+*/
+const size_t read_headroom = 64;
+
+
+/**
+   A few threads which do reads and writes for everybody else, so that while
+   they wait on the disk, the merge can keep going.
+*/
+class IoPool : boost::noncopyable {
+  public:
+  IoPool(const unsigned int threads) : _stopping(false)
+  {
+    for(unsigned int thread = 0; thread < threads; ++thread)
+      _threads.create_thread(boost::bind(&IoPool::work, this));
+  }
+
+  ~IoPool()
+  {
+    {
+      boost::lock_guard<boost::mutex> lock(_mutex);
+      _stopping = true;
+      _changed.notify_all();
+    }
+    _threads.join_all();
+  }
+
+  void submit(const boost::function<void ()> & task)
+  {
+    boost::lock_guard<boost::mutex> lock(_mutex);
+    _tasks.push_back(task);
+    _changed.notify_one();
+  }
+
+  private:
+  void work()
+  {
+    while(true)
+    {
+      boost::function<void ()> task;
+      {
+        boost::unique_lock<boost::mutex> lock(_mutex);
+        while(_tasks.empty() && !_stopping)
+          _changed.wait(lock);
+        if(_tasks.empty())
+          return;
+        task.swap(_tasks.front());
+        _tasks.pop_front();
+      }
+      task();
+    }
+  }
+
+  boost::mutex _mutex;
+  boost::condition_variable _changed;
+  std::deque<boost::function<void ()> > _tasks;
+  bool _stopping;
+  boost::thread_group _threads;
+};
+
+/**
+   A read or write handed to an IoPool, which can be waited on.
+*/
+class PendingIo : boost::noncopyable {
+  public:
+  PendingIo() : _busy(false), _result(0), _error(0) {}
+
+  void start()
+  {
+    boost::lock_guard<boost::mutex> lock(_mutex);
+    _busy = true;
+  }
+
+  void done(const ssize_t result, const int error)
+  {
+    boost::lock_guard<boost::mutex> lock(_mutex);
+    _busy = false;
+    _result = result;
+    _error = error;
+    _changed.notify_all();
+  }
+
+  /**
+     \return how many bytes were read or written, or -1 with `errno` set if
+     it failed. Returns straight away if nothing's pending.
+  */
+  ssize_t wait()
+  {
+    boost::unique_lock<boost::mutex> lock(_mutex);
+    while(_busy)
+      _changed.wait(lock);
+    errno = _error;
+    return _result;
+  }
+
+  private:
+  boost::mutex _mutex;
+  boost::condition_variable _changed;
+  bool _busy;
+  ssize_t _result;
+  int _error;
+};
+
+/**
+   Fills all `bytes` of `buffer` from `descriptor`, unless the file ends first,
+   and lets `pending` know how it went.
+*/
+inline void read_fully(const int descriptor,
+                       char * const buffer,
+                       const size_t bytes,
+                       PendingIo * pending)
+{
+  size_t done = 0;
+  while(done < bytes)
+  {
+    const ssize_t count = read(descriptor, buffer + done, bytes - done);
+    if(count < 0 && errno == EINTR)
+      continue;
+    if(count < 0) {
+      pending->done(-1, errno);
+      return;
+    }
+    if(count == 0)
+      break;
+    done += count;
+  }
+  pending->done(done, 0);
+}
+
+/**
+   Writes all `bytes` of `buffer` to `descriptor`, and lets `pending` know how
+   it went.
+*/
+inline void write_fully(const int descriptor,
+                        const char * const buffer,
+                        const size_t bytes,
+                        PendingIo * pending)
+{
+  size_t done = 0;
+  while(done < bytes)
+  {
+    const ssize_t count = write(descriptor, buffer + done, bytes - done);
+    if(count < 0 && errno == EINTR)
+      continue;
+    if(count < 0) {
+      pending->done(-1, errno);
+      return;
+    }
+    done += count;
+  }
+  pending->done(done, 0);
+}
+
+
+/**
+   An open file descriptor along with a buffer, aligned to a page, for reading
+   or writing it `buffer_bytes` at a time. Throws a std::runtime_error if
+   anything goes wrong.
+
+   Given an IoPool, there are two buffers: one for us, and one for the pool to
+   read into or write from at the same time.
+*/
+class BufferedFile : boost::noncopyable {
+  protected:
+  /**
+     Takes over `descriptor`, which is closed when we're done with it if it's
+     `owned`. Something like stdout isn't.
+  */
+  BufferedFile(const std::string & name,
+               const int descriptor,
+               const bool owned,
+               IoPool * pool,
+               const size_t buffer_bytes)
+      : _filename(name), _descriptor(descriptor), _owned(owned), _pool(pool),
+        _buffer_bytes(buffer_bytes), _buffer(NULL), _spare(NULL)
+  {
+    allocate();
+  }
+
+  static int open_file(const std::string & filename, const int flags)
+  {
+    const int descriptor = open(filename.c_str(), flags, 0644);
+    if(descriptor < 0) {
+      throw std::runtime_error(
+          "Can't open: " + filename + "; " + strerror(errno));
+    }
+    return descriptor;
+  }
+
+  ~BufferedFile()
+  {
+    // Nothing can still be using the buffers once we're gone.
+    _pending.wait();
+    if(_descriptor >= 0 && _owned)
+      close(_descriptor);
+    free(_buffer);
+    free(_spare);
+  }
+
+  void allocate()
+  {
+    void * buffer = NULL;
+    void * spare = NULL;
+    if(posix_memalign(&buffer, 4096, capacity()) != 0 ||
+       (_pool && posix_memalign(&spare, 4096, capacity()) != 0))
+    {
+      free(buffer);
+      if(_owned)
+        close(_descriptor);
+      throw std::runtime_error("Can't allocate a buffer for: " + _filename);
+    }
+    _buffer = static_cast<char *>(buffer);
+    _spare = static_cast<char *>(spare);
+  }
+
+  void fail(const std::string & what) const
+  {
+    throw std::runtime_error(
+        "Can't " + what + ": " + _filename + "; " + strerror(errno));
+  }
+
+  size_t capacity() const { return read_headroom + _buffer_bytes; }
+
+  std::string _filename;
+  int _descriptor;
+  bool _owned;
+
+  IoPool * _pool;
+  PendingIo _pending;
+
+  const size_t _buffer_bytes;
+  char * _buffer;
+  char * _spare;
+};
+
+/**
+   Writes to a file through a buffer. With an IoPool, the buffer is written in
+   the background while the next one fills.
+*/
+class BufferedWriter : protected BufferedFile {
+  public:
+  BufferedWriter(const std::string & filename,
+                 IoPool * pool = NULL,
+                 const size_t buffer_bytes = io_buffer_bytes)
+      : BufferedFile(filename,
+                     open_file(filename, O_WRONLY | O_CREAT | O_TRUNC),
+                     true,
+                     pool,
+                     buffer_bytes),
+        _used(0), _bytes(0), _durable(false)
+  {}
+
+  BufferedWriter(const std::string & name,
+                 const int descriptor,
+                 IoPool * pool = NULL,
+                 const size_t buffer_bytes = io_buffer_bytes)
+      : BufferedFile(name, descriptor, false, pool, buffer_bytes), _used(0),
+        _bytes(0), _durable(false)
+  {}
+
+  /**
+     Keeps a checksum of everything written from here on, and makes sure it's
+     all on disk, not just handed to the kernel, before `finish()` returns.
+  */
+  void make_durable()
+  {
+    _durable = true;
+  }
+
+  /**
+     Writes whatever is left in the buffer, and closes the file if it's ours.
+  */
+  void finish()
+  {
+    flush();
+    if(_pending.wait() < 0)
+      fail("write");
+    if(_durable && fsync(_descriptor) != 0)
+      fail("sync");
+    if(!_owned)
+      return;
+    if(close(_descriptor) != 0) {
+      _descriptor = -1;
+      fail("write");
+    }
+    _descriptor = -1;
+  }
+
+  const std::string & name() const { return _filename; }
+
+  /**
+     \return how many bytes have been written so far, less whatever's still in
+     the buffer.
+  */
+  uint64_t bytes() const { return _bytes; }
+
+  /**
+     \return the CRC-32 of everything written since `make_durable()`, less
+     whatever's still in the buffer.
+  */
+  uint32_t checksum() const { return _checksum.checksum(); }
+
+  protected:
+  /**
+     Copies all `bytes` of `data` into the buffer, writing it out as often as
+     it fills up.
+  */
+  void put(const char * data, size_t bytes)
+  {
+    while(bytes)
+    {
+      const size_t count = std::min(bytes, _buffer_bytes - _used);
+      memcpy(_buffer + _used, data, count);
+      _used += count;
+      data += count;
+      bytes -= count;
+      if(_used == _buffer_bytes)
+        flush();
+    }
+  }
+
+  void flush()
+  {
+    _bytes += _used;
+    if(_durable)
+      _checksum.process_bytes(_buffer, _used);
+
+    if(_pool) {
+      // Only one write at a time, so they land in order.
+      if(_pending.wait() < 0)
+        fail("write");
+      _pending.start();
+      _pool->submit(
+          boost::bind(write_fully, _descriptor, _buffer, _used, &_pending));
+      std::swap(_buffer, _spare);
+      _used = 0;
+      return;
+    }
+
+    size_t written = 0;
+    while(written < _used)
+    {
+      const ssize_t count =
+          write(_descriptor, _buffer + written, _used - written);
+      if(count < 0 && errno == EINTR)
+        continue;
+      if(count < 0)
+        fail("write");
+      written += count;
+    }
+    _used = 0;
+  }
+
+  size_t _used;
+  uint64_t _bytes;
+  bool _durable;
+  boost::crc_32_type _checksum;
+};
+
+/**
+   Reads from a file through a buffer. With an IoPool, the next buffer is read
+   in the background while this one is used up.
+*/
+class BufferedReader : protected BufferedFile {
+  public:
+  BufferedReader(const std::string & filename,
+                 IoPool * pool = NULL,
+                 const size_t buffer_bytes = io_buffer_bytes)
+      : BufferedFile(filename,
+                     open_file(filename, O_RDONLY),
+                     true,
+                     pool,
+                     buffer_bytes),
+        _position(0), _size(0), _end(false)
+  {
+    posix_fadvise(_descriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+    if(_pool)
+      read_ahead();
+  }
+
+  /**
+     \return how big the file is, in bytes.
+  */
+  size_t size() const
+  {
+    struct stat status;
+    if(fstat(_descriptor, &status) != 0)
+      fail("stat");
+    return status.st_size;
+  }
+
+  protected:
+  /**
+     Moves whatever hasn't been read yet to the front of the buffer, and fills
+     the rest from the file.
+
+     \return false if there was nothing more in the file.
+  */
+  bool refill()
+  {
+    if(_end)
+      return false;
+
+    const size_t left = _size - _position;
+    if(_pool) {
+      const ssize_t count = _pending.wait();
+      if(count < 0)
+        fail("read");
+      if(left > read_headroom)
+        throw std::logic_error("Read ahead with too much left in the buffer.");
+
+      memcpy(_spare + read_headroom - left, _buffer + _position, left);
+      std::swap(_buffer, _spare);
+      _position = read_headroom - left;
+      _size = read_headroom + count;
+      _end = count == 0;
+      if(!_end)
+        read_ahead();
+      return count != 0;
+    }
+
+    memmove(_buffer, _buffer + _position, left);
+    _size = left;
+    _position = 0;
+
+    while(true)
+    {
+      const ssize_t count =
+          read(_descriptor, _buffer + _size, capacity() - _size);
+      if(count < 0 && errno == EINTR)
+        continue;
+      if(count < 0)
+        fail("read");
+      _size += count;
+      _end = count == 0;
+      return count != 0;
+    }
+  }
+
+  /**
+     Copies the next `bytes` bytes of the file into `data`, refilling the
+     buffer as often as it runs out.
+
+     \return false if the file had already ended. Throws if it ends part of
+     the way through.
+  */
+  bool take(char * data, size_t bytes)
+  {
+    bool any = false;
+    while(bytes)
+    {
+      if(_position == _size && !refill()) {
+        if(any)
+          fail_truncated();
+        return false;
+      }
+      const size_t count = std::min(bytes, _size - _position);
+      memcpy(data, _buffer + _position, count);
+      _position += count;
+      data += count;
+      bytes -= count;
+      any = true;
+    }
+    return true;
+  }
+
+  void fail_truncated() const
+  {
+    throw std::runtime_error("Ends part of the way through: " + _filename);
+  }
+
+  size_t _position;
+  size_t _size;
+  bool _end;
+
+  private:
+  void read_ahead()
+  {
+    _pending.start();
+    _pool->submit(boost::bind(read_fully,
+                              _descriptor,
+                              _spare + read_headroom,
+                              _buffer_bytes,
+                              &_pending));
+  }
+};
+
+/**
+   \return `io_threads` threads to read and write in the background with, or
+   NULL to do it all in the foreground if there are none.
+*/
+inline IoPool * make_io_pool(const unsigned int io_threads)
+{
+  return io_threads ? new IoPool(io_threads) : NULL;
+}
+
+/**
+   \return how big a buffer each of `files` files can have, to share `memory`
+   between them, when each has two with a `pool`. Never less than
+   `min_buffer_bytes`, so it's up to the caller not to have too many files,
+   and never more than `io_buffer_bytes`, which is plenty.
+*/
+inline size_t buffer_bytes(const size_t memory,
+                           const size_t files,
+                           const IoPool * pool = NULL)
+{
+  const size_t share = memory / std::max<size_t>(files, 1) / (pool ? 2 : 1);
+  return std::min(std::max(share, min_buffer_bytes), io_buffer_bytes);
+}
+
+
+/**
+   \return roughly how much memory `record` takes up.
+*/
+template <class Record>
+size_t record_bytes(const Record & record)
+{
+  return sizeof(record);
+}
+
+inline size_t record_bytes(const std::string & record)
+{
+  return sizeof(record) + record.capacity();
+}
+
+/**
+   Writes records to a file, as their raw bytes, so they'd better not hold any
+   pointers.
+*/
+template <class Record>
+class RecordWriter : public BufferedWriter {
+  static_assert(std::is_trivially_copyable<Record>::value,
+                "Only records which can be copied byte for byte can be "
+                "written as they are.");
+
+  public:
+  RecordWriter(const std::string & filename,
+               IoPool * pool = NULL,
+               const size_t buffer_bytes = io_buffer_bytes)
+      : BufferedWriter(filename, pool, buffer_bytes)
+  {}
+
+  void write(const Record & record)
+  {
+    if(_used + sizeof(record) > _buffer_bytes) {
+      put(reinterpret_cast<const char *>(&record), sizeof(record));
+      return;
+    }
+    memcpy(_buffer + _used, &record, sizeof(record));
+    _used += sizeof(record);
+  }
+};
+
+/**
+   Writes strings to a file, each as its length and then its bytes.
+*/
+template <>
+class RecordWriter<std::string> : public BufferedWriter {
+  public:
+  RecordWriter(const std::string & filename,
+               IoPool * pool = NULL,
+               const size_t buffer_bytes = io_buffer_bytes)
+      : BufferedWriter(filename, pool, buffer_bytes)
+  {}
+
+  void write(const std::string & record)
+  {
+    const uint64_t length = record.size();
+    put(reinterpret_cast<const char *>(&length), sizeof(length));
+    put(record.data(), record.size());
+  }
+};
+
+/**
+   Reads records back out of a file written by a RecordWriter.
+*/
+template <class Record>
+class RecordReader : public BufferedReader {
+  public:
+  RecordReader(const std::string & filename,
+               IoPool * pool = NULL,
+               const size_t buffer_bytes = io_buffer_bytes)
+      : BufferedReader(filename, pool, buffer_bytes)
+  {}
+
+  bool read(Record & record)
+  {
+    if(_size - _position < sizeof(record))
+      return take(reinterpret_cast<char *>(&record), sizeof(record));
+    memcpy(&record, _buffer + _position, sizeof(record));
+    _position += sizeof(record);
+    return true;
+  }
+};
+
+template <>
+class RecordReader<std::string> : public BufferedReader {
+  public:
+  RecordReader(const std::string & filename,
+               IoPool * pool = NULL,
+               const size_t buffer_bytes = io_buffer_bytes)
+      : BufferedReader(filename, pool, buffer_bytes)
+  {}
+
+  bool read(std::string & record)
+  {
+    uint64_t length;
+    if(!take(reinterpret_cast<char *>(&length), sizeof(length)))
+      return false;
+    record.resize(length);
+    if(length && !take(&record[0], length))
+      fail_truncated();
+    return true;
+  }
+};
+
+/**
+   Reads newline-delimited strings out of a text file. The newlines aren't
+   part of the strings, and there needn't be one at the very end.
+*/
+class LineReader : public BufferedReader {
+  public:
+  LineReader(const std::string & filename,
+             IoPool * pool = NULL,
+             const size_t buffer_bytes = io_buffer_bytes)
+      : BufferedReader(filename, pool, buffer_bytes)
+  {}
+
+  bool read(std::string & line)
+  {
+    line.clear();
+    bool any = false;
+    while(true)
+    {
+      if(_position == _size && !refill())
+        return any;
+
+      const char * const start = _buffer + _position;
+      const char * const newline = static_cast<const char *>(
+          memchr(start, '\n', _size - _position));
+      if(newline) {
+        line.append(start, newline);
+        _position = newline + 1 - _buffer;
+        return true;
+      }
+
+      line.append(start, _size - _position);
+      _position = _size;
+      any = true;
+    }
+  }
+};
+
+/**
+   Writes strings to a text file, one per line.
+*/
+class LineWriter : public BufferedWriter {
+  public:
+  LineWriter(const std::string & filename,
+             IoPool * pool = NULL,
+             const size_t buffer_bytes = io_buffer_bytes)
+      : BufferedWriter(filename, pool, buffer_bytes)
+  {}
+
+  void write(const std::string & line)
+  {
+    put(line.data(), line.size());
+    put("\n", 1);
+  }
+};
+
+
+/**
+   A directory of our own for the runs, inside another, and the names of every
+   file in it we've made. Unless it's `resumable`, it's a new one, made by
+   `mkdtemp()`, and it's emptied and removed when we're done with it, come
+   what may. A resumable one always has the same name, `resume_name`, and
+   whatever is in it is left there if we don't get as far as `finished()`, so
+   a manifest can pick up from it next time. Either way, it's only removed if
+   it's empty, and so is the directory it's in, if we made that too.
+*/
+class TempDirectory : boost::noncopyable {
+  public:
+  static const char * resume_name() { return "external_sort.resume"; }
+
+  TempDirectory(const std::string & directory, const bool resumable = false)
+      : _resumable(resumable), _finished(false), _made_parent(false),
+        _count(0)
+  {
+    const std::string where = directory.empty() ? "." : directory;
+    if(resumable) {
+      make_directory(where, _made_parent);
+      _parent = where;
+      _path = where + "/" + resume_name();
+      bool made;
+      make_directory(_path, made);
+      return;
+    }
+
+    std::string pattern = where + "/external_sort.XXXXXX";
+    if(!mkdtemp(&pattern[0])) {
+      throw std::runtime_error(
+          "Can't make a directory in: " + where + "; " + strerror(errno));
+    }
+    _path = pattern;
+  }
+
+  ~TempDirectory()
+  {
+    if(_resumable && !_finished)
+      return;
+    for(size_t i = 0; i < _files.size(); ++i)
+      remove(_files[i].c_str());
+    rmdir(_path.c_str());
+    if(_made_parent)
+      rmdir(_parent.c_str());
+  }
+
+  /**
+     \return the path of the file called `name` in the directory.
+  */
+  std::string path(const std::string & name) const
+  {
+    return _path + "/" + name;
+  }
+
+  /**
+     \return the path of a new file, `prefix` followed by a number that no
+     other file we've made or adopted has.
+  */
+  std::string make(const std::string & prefix)
+  {
+    boost::lock_guard<boost::mutex> lock(_mutex);
+    _files.push_back(
+        path(prefix + "_" + boost::lexical_cast<std::string>(++_count)));
+    return _files.back();
+  }
+
+  /**
+     Counts the file at `file`, made by some earlier sort, as one of ours, to
+     be cleaned up along with the rest.
+  */
+  void adopt(const std::string & file)
+  {
+    boost::lock_guard<boost::mutex> lock(_mutex);
+    _files.push_back(file);
+    const size_t number = file.find_last_of('_');
+    if(number != std::string::npos) {
+      _count = std::max<size_t>(
+          _count, strtoul(file.c_str() + number + 1, NULL, 10));
+    }
+  }
+
+  /**
+     Lets us clean up after ourselves on the way out, even if we're
+     resumable: the sort's done, so there's nothing left to resume.
+  */
+  void finished() { _finished = true; }
+
+  bool resumable() const { return _resumable; }
+
+  const std::string & directory() const { return _path; }
+
+  private:
+  /**
+     Makes a directory at `path` unless there's one there already, and sets
+     `made` to whether it did.
+  */
+  static void make_directory(const std::string & path, bool & made)
+  {
+    made = mkdir(path.c_str(), 0755) == 0;
+    if(!made && errno != EEXIST) {
+      throw std::runtime_error(
+          "Can't make a directory: " + path + "; " + strerror(errno));
+    }
+  }
+
+  std::string _path;
+  bool _resumable;
+  bool _finished;
+
+  /**
+     Where a resumable directory is, and whether we made that too.
+  */
+  std::string _parent;
+  bool _made_parent;
+
+  boost::mutex _mutex;
+  std::vector<std::string> _files;
+  size_t _count;
+};
+
+/**
+   The path of a file which is removed when this goes out of scope, unless
+   it's been kept by then. For outputs which are only any good once they're
+   finished.
+*/
+class ScopedFile : boost::noncopyable {
+  public:
+  ScopedFile(const std::string & path) : _path(path), _kept(false) {}
+
+  ~ScopedFile()
+  {
+    if(!_kept)
+      remove(_path.c_str());
+  }
+
+  const std::string & path() const { return _path; }
+
+  void keep() { _kept = true; }
+
+  private:
+  std::string _path;
+  bool _kept;
+};
+
+
+/**
+   A finished run: where it is, and how big it is and what its CRC-32 is
+   supposed to be.
+*/
+struct RunFile {
+  RunFile() : bytes(0), checksum(0) {}
+
+  RunFile(const std::string & the_path,
+          const uint64_t the_bytes,
+          const uint32_t the_checksum)
+      : path(the_path), bytes(the_bytes), checksum(the_checksum)
+  {}
+
+  std::string path;
+  uint64_t bytes;
+  uint32_t checksum;
+};
+
+/**
+   \return whether the file at `run.path` is still the size it was written
+   with, and still has the same CRC-32.
+*/
+inline bool intact(const RunFile & run)
+{
+  const int descriptor = open(run.path.c_str(), O_RDONLY);
+  if(descriptor < 0)
+    return false;
+
+  boost::crc_32_type checksum;
+  std::vector<char> buffer(io_buffer_bytes);
+  uint64_t bytes = 0;
+  while(true)
+  {
+    const ssize_t count = read(descriptor, &buffer[0], buffer.size());
+    if(count < 0 && errno == EINTR)
+      continue;
+    if(count <= 0) {
+      close(descriptor);
+      return count == 0 && bytes == run.bytes &&
+          checksum.checksum() == run.checksum;
+    }
+    checksum.process_bytes(&buffer[0], count);
+    bytes += count;
+  }
+}
+
+/**
+   A record of how far a sort got, kept in its directory, so that a sort which
+   dies can pick up from the last step it finished rather than from nothing:
+   how many of the input's records are in runs, whether that's all of them,
+   how many merge passes are done, and which runs are left, each with the
+   size and checksum it was written with.
+
+   Runs are only listed once they're on disk, and the manifest is only ever
+   replaced whole, by `rename()`, so whatever it says is always true.
+*/
+class Manifest : boost::noncopyable {
+  public:
+  /**
+     Reads the manifest in `directory`, if there's one there for the same
+     `fingerprint` and every run it lists is intact, or starts from nothing if
+     not. Either way, any run in the directory it doesn't list is half
+     written, and removed.
+  */
+  Manifest(TempDirectory & directory, const std::string & fingerprint)
+      : _directory(directory), _fingerprint(fingerprint), _consumed(0),
+        _complete(false), _passes(0)
+  {
+    // No line breaks, so it stays on the one line.
+    std::replace(_fingerprint.begin(), _fingerprint.end(), '\n', ' ');
+
+    const std::string manifest = directory.path("manifest");
+    _directory.adopt(manifest);
+    _directory.adopt(manifest + ".new");
+    if(!load()) {
+      _consumed = 0;
+      _complete = false;
+      _passes = 0;
+      _runs.clear();
+    }
+
+    std::vector<std::string> listed;
+    for(size_t run = 0; run < _runs.size(); ++run)
+    {
+      _directory.adopt(_runs[run].path);
+      listed.push_back(_runs[run].path);
+    }
+    std::sort(listed.begin(), listed.end());
+    remove_unlisted(listed);
+  }
+
+  uint64_t consumed() const { return _consumed; }
+
+  bool complete() const { return _complete; }
+
+  size_t passes() const { return _passes; }
+
+  std::vector<std::string> runs() const
+  {
+    std::vector<std::string> paths;
+    for(size_t run = 0; run < _runs.size(); ++run)
+      paths.push_back(_runs[run].path);
+    return paths;
+  }
+
+  /**
+     Records that `runs` are finished too, and that with the ones before them
+     they hold the first `consumed` records of the input, or all of them if
+     it's `complete`.
+  */
+  void add_runs(const std::vector<RunFile> & runs,
+                const uint64_t consumed,
+                const bool complete)
+  {
+    _runs.insert(_runs.end(), runs.begin(), runs.end());
+    _consumed = consumed;
+    _complete = complete;
+    save();
+  }
+
+  /**
+     Records that the runs at `group` have been merged into `merged`, which
+     takes their place. They're removed, once it's on record.
+  */
+  void merged(const std::vector<std::string> & group, const RunFile & merged)
+  {
+    std::vector<RunFile> runs;
+    bool replaced = false;
+    for(size_t run = 0; run < _runs.size(); ++run)
+    {
+      if(std::find(group.begin(), group.end(), _runs[run].path) ==
+         group.end())
+      {
+        runs.push_back(_runs[run]);
+      }
+      else if(!replaced) {
+        runs.push_back(merged);
+        replaced = true;
+      }
+    }
+    _runs.swap(runs);
+    save();
+
+    for(size_t run = 0; run < group.size(); ++run)
+      remove(group[run].c_str());
+  }
+
+  /**
+     Records that another merge pass is done.
+  */
+  void pass_done()
+  {
+    ++_passes;
+    save();
+  }
+
+  private:
+  bool load()
+  {
+    std::ifstream file(_directory.path("manifest").c_str());
+    std::string line, fingerprint;
+    if(!getline(file, line) || line != "external_sort manifest 1" ||
+       !getline(file, fingerprint) || fingerprint != _fingerprint)
+    {
+      return false;
+    }
+
+    file >> _consumed >> _complete >> _passes;
+    size_t runs = 0;
+    file >> runs;
+    for(size_t run = 0; file && run < runs; ++run)
+    {
+      RunFile run_file;
+      file >> run_file.bytes >> run_file.checksum >> run_file.path;
+      run_file.path = _directory.path(run_file.path);
+      _runs.push_back(run_file);
+    }
+
+    std::string end;
+    if(!(file >> end) || end != "end" || _runs.size() != runs)
+      return false;
+
+    for(size_t run = 0; run < _runs.size(); ++run)
+    {
+      if(!intact(_runs[run]))
+        return false;
+    }
+    return true;
+  }
+
+  void save()
+  {
+    const std::string manifest = _directory.path("manifest");
+    const std::string replacement = manifest + ".new";
+    {
+      std::ofstream file(replacement.c_str(), std::ios::trunc);
+      file << "external_sort manifest 1\n"
+           << _fingerprint << "\n"
+           << _consumed << " " << _complete << " " << _passes << "\n"
+           << _runs.size() << "\n";
+      for(size_t run = 0; run < _runs.size(); ++run)
+      {
+        const std::string & path = _runs[run].path;
+        file << _runs[run].bytes << " " << _runs[run].checksum << " "
+             << path.substr(path.find_last_of('/') + 1) << "\n";
+      }
+      file << "end\n";
+      file.flush();
+      if(!file)
+        throw std::runtime_error("Can't write: " + replacement);
+    }
+
+    sync_file(replacement);
+    if(rename(replacement.c_str(), manifest.c_str()) != 0) {
+      throw std::runtime_error(
+          "Can't replace: " + manifest + "; " + strerror(errno));
+    }
+    // And the rename itself, along with every run's name.
+    sync_file(_directory.directory());
+  }
+
+  static void sync_file(const std::string & path)
+  {
+    const int descriptor = open(path.c_str(), O_RDONLY);
+    if(descriptor < 0 || fsync(descriptor) != 0) {
+      const int error = errno;
+      if(descriptor >= 0)
+        close(descriptor);
+      throw std::runtime_error(
+          "Can't sync: " + path + "; " + strerror(error));
+    }
+    close(descriptor);
+  }
+
+  /**
+     \return whether `name` is what TempDirectory calls a file it makes with
+     `prefix`: the prefix, an underscore, and a number.
+  */
+  static bool made_with(const std::string & name, const std::string & prefix)
+  {
+    if(name.size() <= prefix.size() + 1 ||
+       name.compare(0, prefix.size(), prefix) != 0 ||
+       name[prefix.size()] != '_')
+    {
+      return false;
+    }
+    return name.find_first_not_of("0123456789", prefix.size() + 1) ==
+        std::string::npos;
+  }
+
+  /**
+     Removes any run or merge in the directory that isn't in `listed`, which
+     is sorted. Nothing else is touched, even though the directory's ours.
+  */
+  void remove_unlisted(const std::vector<std::string> & listed)
+  {
+    DIR * directory = opendir(_directory.directory().c_str());
+    if(!directory)
+      return;
+    while(const dirent * entry = readdir(directory))
+    {
+      const std::string name = entry->d_name;
+      const std::string path = _directory.path(name);
+      if((made_with(name, "run") || made_with(name, "merge")) &&
+         !std::binary_search(listed.begin(), listed.end(), path))
+      {
+        remove(path.c_str());
+      }
+    }
+    closedir(directory);
+  }
+
+  TempDirectory & _directory;
+  std::string _fingerprint;
+
+  uint64_t _consumed;
+  bool _complete;
+  size_t _passes;
+  std::vector<RunFile> _runs;
+};
+
+
+/**
+   \return the time in seconds since some fixed point in the past.
+*/
+inline double seconds()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+   What a sort did, and where the time went.
+*/
+struct Stats {
+  Stats()
+      : records(0), runs(0), passes(0), generation_seconds(0),
+        merge_seconds(0), temp_bytes_written(0), temp_bytes_read(0)
+  {}
+
+  /// How many records were sorted.
+  uint64_t records;
+
+  /// How many runs the input was made into.
+  size_t runs;
+
+  /// How many merge passes it took, counting the last.
+  size_t passes;
+
+  /// How long it took to read the input and make the runs.
+  double generation_seconds;
+
+  /// How long it took to merge them, including writing the output.
+  double merge_seconds;
+
+  /// How much was written to and read back from runs, in bytes.
+  uint64_t temp_bytes_written;
+  uint64_t temp_bytes_read;
+};
+
+/**
+   How to go about a sort.
+*/
+struct Options {
+  Options()
+      : memory(64 * 1024 * 1024), threads(1), io_threads(2), pool(NULL),
+        temp_directory("."), stats(NULL)
+  {}
+
+  /**
+     Roughly how many bytes to sort in. The input and output aren't counted,
+     so whoever makes them should take their buffers out of this first; see
+     `outer_buffer_bytes()`.
+  */
+  size_t memory;
+
+  /// How many threads to make runs with.
+  unsigned int threads;
+
+  /**
+     How many threads to read ahead and write behind with, so that merging
+     never waits on the disk and the disk never waits on merging, or 0 to do
+     it all in the foreground.
+  */
+  unsigned int io_threads;
+
+  /**
+     If not NULL, the threads to read ahead and write behind with, shared
+     with whoever made them, such as for the input and output, rather than
+     `io_threads` more of the sort's own.
+  */
+  IoPool * pool;
+
+  /// Where to put the runs while they're being made and merged.
+  std::string temp_directory;
+
+  /**
+     If not empty, the runs go in a directory of ours in this one instead,
+     the same one every time, along with a Manifest of how far the sort has
+     got. Should the sort die, sorting the same input again with the same
+     directory picks up where it left off. Everything's cleaned up once the
+     sort's done, and nothing else in this directory is touched.
+  */
+  std::string resume_directory;
+
+  /**
+     Anything that tells this input apart from any other, such as its name,
+     size and modification time, so that a manifest left behind by some other
+     sort is never picked up from.
+  */
+  std::string fingerprint;
+
+  /// If not NULL, filled in with what the sort did.
+  Stats * stats;
+};
+
+/**
+   \return how big a buffer to read a sort's input through, and write its
+   output through, out of `memory` for the whole thing, when they read and
+   write in the background with a `pool`: about an eighth of `memory` between
+   them.
+*/
+inline size_t outer_buffer_bytes(const size_t memory,
+                                 const IoPool * pool = NULL)
+{
+  return buffer_bytes(memory / 8, 2, pool);
+}
+
+/**
+   \return what's left of `memory` for the sort itself once its input and
+   output have buffers of `outer_buffer_bytes(memory, pool)`.
+*/
+inline size_t sort_memory(const size_t memory, const IoPool * pool = NULL)
+{
+  const size_t outer = 2 * outer_buffer_bytes(memory, pool) * (pool ? 2 : 1);
+  return memory > outer ? memory - outer : 0;
+}
+
+
+/**
+   The key of a record that's the whole record.
+*/
+template <class Record>
+struct Identity {
+  const Record & operator()(const Record & record) const { return record; }
+};
+
+/**
+   The type of key that `KeyFn` gives back for a `Record`.
+*/
+template <class Record, class KeyFn>
+struct KeyOf {
+  typedef typename std::decay<
+    typename std::result_of<const KeyFn & (const Record &)>::type>::type type;
+};
+
+/**
+   Orders records by `compare` on their keys.
+*/
+template <class Record, class KeyFn, class Compare>
+class RecordLess {
+  public:
+  typedef typename KeyOf<Record, KeyFn>::type Key;
+
+  RecordLess(const KeyFn & key, const Compare & compare)
+      : _key(key), _compare(compare)
+  {}
+
+  bool operator()(const Record & a, const Record & b) const
+  {
+    return _compare(_key(a), _key(b));
+  }
+
+  const KeyFn & key() const { return _key; }
+
+  /**
+     Whether `std::less` on the keys is the same as comparing them a byte at a
+     time, as RadixDigits sees them, from the most significant byte down.
+  */
+  static const bool radix_sortable =
+      std::is_same<Compare, std::less<Key> >::value;
+
+  private:
+  KeyFn _key;
+  Compare _compare;
+};
+
+/**
+   How to split a key into bytes to radix sort it by, for the keys that can
+   be: `count` of them, from least significant to most.
+*/
+template <class Key, class Enable = void>
+struct RadixDigits {
+  static const bool sortable = false;
+  static const size_t count = 0;
+  static unsigned char digit(const Key &, const size_t) { return 0; }
+};
+
+template <class Key>
+struct RadixDigits<
+  Key,
+  typename std::enable_if<std::is_integral<Key>::value &&
+                          !std::is_same<Key, bool>::value>::type>
+{
+  static const bool sortable = true;
+  static const size_t count = sizeof(Key);
+
+  static unsigned char digit(const Key & key, const size_t which)
+  {
+    typedef typename std::make_unsigned<Key>::type Unsigned;
+    Unsigned bits = Unsigned(key);
+    // Negative numbers come first.
+    if(std::is_signed<Key>::value)
+      bits ^= Unsigned(1) << (8 * sizeof(Key) - 1);
+    return bits >> (8 * which);
+  }
+};
+
+template <size_t Size>
+struct RadixDigits<boost::array<unsigned char, Size> > {
+  static const bool sortable = true;
+  static const size_t count = Size;
+
+  static unsigned char digit(const boost::array<unsigned char, Size> & key,
+                             const size_t which)
+  {
+    return key[Size - 1 - which];
+  }
+};
+
+/**
+   Sorts `records` by `less`, which orders them by keys RadixDigits can
+   split, a byte at a time, least significant first. Bytes which are the same
+   in every key are skipped. `scratch` ends up holding whatever it likes.
+*/
+template <class Record, class Less>
+void radix_sort(std::vector<Record> & records,
+                std::vector<Record> & scratch,
+                const Less & less)
+{
+  typedef RadixDigits<typename Less::Key> Digits;
+  if(records.size() < 2)
+    return;
+
+  // Count every byte of every key in one go.
+  std::vector<size_t> counts(Digits::count * 256, 0);
+  for(size_t i = 0; i < records.size(); ++i)
+  {
+    const typename Less::Key & key = less.key()(records[i]);
+    for(size_t digit = 0; digit < Digits::count; ++digit)
+      ++counts[digit * 256 + Digits::digit(key, digit)];
+  }
+
+  scratch.resize(records.size());
+  for(size_t digit = 0; digit < Digits::count; ++digit)
+  {
+    size_t * const count = &counts[digit * 256];
+    if(count[Digits::digit(less.key()(records[0]), digit)] == records.size())
+      continue;
+
+    size_t offset = 0;
+    for(size_t value = 0; value < 256; ++value) {
+      const size_t here = count[value];
+      count[value] = offset;
+      offset += here;
+    }
+
+    for(size_t i = 0; i < records.size(); ++i)
+    {
+      const unsigned char value =
+          Digits::digit(less.key()(records[i]), digit);
+      std::swap(scratch[count[value]++], records[i]);
+    }
+    records.swap(scratch);
+  }
+}
+
+/**
+   Sorts `records` by `less`, by radix sort if it can be done that way.
+*/
+template <class Record, class Less>
+void sort_records(std::vector<Record> & records,
+                  std::vector<Record> & scratch,
+                  const Less & less)
+{
+  if(Less::radix_sortable && RadixDigits<typename Less::Key>::sortable)
+    radix_sort(records, scratch, less);
+  else
+    std::sort(records.begin(), records.end(), less);
+}
+
+
+/**
+   Everything the run generating workers share: blocks of records read from
+   the input waiting to be taken, and the runs written so far.
+*/
+template <class Record>
+struct RunGeneration {
+  RunGeneration(const size_t the_queue_limit,
+                TempDirectory & the_temp,
+                IoPool * the_pool,
+                const size_t the_buffer_bytes,
+                const bool the_durable)
+      : queue_limit(the_queue_limit), done(false), temp(the_temp),
+        pool(the_pool), buffer_bytes(the_buffer_bytes), durable(the_durable),
+        flushed(0), checkpoint(0)
+  {}
+
+  boost::mutex mutex;
+  boost::condition_variable changed;
+
+  /// An empty block asks whoever takes it to write out all it holds.
+  std::deque<std::vector<Record> > blocks;
+  size_t queue_limit;
+  bool done;
+
+  /// Every run finished so far, in the order they were.
+  std::vector<RunFile> runs;
+
+  /// Why a worker gave up, if one did.
+  boost::exception_ptr error;
+
+  /// Where the runs go.
+  TempDirectory & temp;
+
+  /// Where runs are written from, if they're written in the background.
+  IoPool * pool;
+
+  /// How big a buffer each run is written through.
+  size_t buffer_bytes;
+
+  /// Whether the runs are synced to disk and checksummed, for a Manifest.
+  bool durable;
+
+  /**
+     How many workers have written out all they hold for the current
+     checkpoint, and how many checkpoints there have been.
+  */
+  unsigned int flushed;
+  size_t checkpoint;
+
+  /**
+     \return a new writer for the next run.
+  */
+  RecordWriter<Record> * next_run()
+  {
+    RecordWriter<Record> * const run =
+        new RecordWriter<Record>(temp.make("run"), pool, buffer_bytes);
+    if(durable)
+      run->make_durable();
+    return run;
+  }
+
+  /**
+     Finishes `run`, and counts it among the runs written.
+  */
+  void finish_run(RecordWriter<Record> & run)
+  {
+    run.finish();
+    boost::lock_guard<boost::mutex> lock(mutex);
+    runs.push_back(RunFile(run.name(), run.bytes(), run.checksum()));
+  }
+
+  /**
+     Puts the next block of input into `block`, or returns false if there are
+     none left.
+  */
+  bool next_block(std::vector<Record> & block)
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while(blocks.empty() && !done)
+      changed.wait(lock);
+
+    if(blocks.empty())
+      return false;
+
+    block.swap(blocks.front());
+    blocks.pop_front();
+    changed.notify_all();
+    return true;
+  }
+
+  /**
+     Lets whoever asked for a checkpoint know that a worker has written out
+     all it holds, and waits for the checkpoint to be recorded.
+  */
+  void flush_done()
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    const size_t current = checkpoint;
+    ++flushed;
+    changed.notify_all();
+    while(checkpoint == current && !done)
+      changed.wait(lock);
+  }
+};
+
+/**
+   However little memory we're given, runs any shorter than this would just
+   mean more of them to merge than there's memory to buffer.
+*/
+const size_t min_run_records = 16 * 1024;
+
+/**
+   Turns a stream of records into runs. Keeps a heap of up to `budget` bytes of
+   records, each tagged with the run it belongs in, and writes out the
+   smallest of them each time another comes in. A record smaller than the last
+   one written can't go in the current run any more, so it's tagged for the
+   next.
+*/
+template <class Record, class Less>
+class ReplacementSelection {
+  public:
+  ReplacementSelection(RunGeneration<Record> & generation,
+                       const size_t budget,
+                       const Less & less)
+      : _generation(generation), _budget(budget), _order(less), _bytes(0),
+        _current_run(0), _written(false)
+  {}
+
+  void add(const Record & record)
+  {
+    // Fill up the heap before writing anything.
+    while(_heap.size() >= min_run_records && _bytes >= _budget)
+      write_smallest();
+
+    const bool next = _written && _order.less(record, _last);
+    push(Entry(next ? _current_run + 1 : _current_run, record));
+  }
+
+  /**
+     Writes out everything left in the heap, after which we start again from
+     an empty one.
+  */
+  void finish()
+  {
+    while(!_heap.empty())
+      write_smallest();
+    if(_run) {
+      _generation.finish_run(*_run);
+      _run.reset();
+    }
+    _written = false;
+  }
+
+  private:
+  typedef std::pair<size_t, Record> Entry; // (run, record)
+
+  /**
+     Puts entries for earlier runs, and then smaller records, on top.
+  */
+  struct Order {
+    Order(const Less & the_less) : less(the_less) {}
+
+    bool operator()(const Entry & a, const Entry & b) const
+    {
+      if(a.first != b.first)
+        return a.first > b.first;
+      return less(b.second, a.second);
+    }
+
+    Less less;
+  };
+
+  static size_t entry_bytes(const Entry & entry)
+  {
+    return sizeof(entry) - sizeof(entry.second) + record_bytes(entry.second);
+  }
+
+  void push(const Entry & entry)
+  {
+    _heap.push_back(entry);
+    std::push_heap(_heap.begin(), _heap.end(), _order);
+    _bytes += entry_bytes(_heap.back());
+  }
+
+  void write_smallest()
+  {
+    std::pop_heap(_heap.begin(), _heap.end(), _order);
+    Entry & smallest = _heap.back();
+    _bytes -= entry_bytes(smallest);
+
+    if(smallest.first != _current_run || !_run) {
+      if(_run)
+        _generation.finish_run(*_run);
+      _run.reset(_generation.next_run());
+      _current_run = smallest.first;
+    }
+    std::swap(_last, smallest.second);
+    _heap.pop_back();
+    _run->write(_last);
+    _written = true;
+  }
+
+  RunGeneration<Record> & _generation;
+  const size_t _budget;
+  const Order _order;
+  std::vector<Entry> _heap;
+  size_t _bytes;
+
+  size_t _current_run;
+  boost::scoped_ptr<RecordWriter<Record> > _run;
+  Record _last;
+  bool _written;
+};
+
+/**
+   Turns a stream of records into runs by collecting up to `budget` bytes of
+   them at a time, sorting those, and writing them out. Half the budget goes
+   to the records, and half to somewhere to radix sort them into, both made
+   room for up front so neither ever grows past it.
+*/
+template <class Record, class Less>
+class SortedRuns {
+  public:
+  SortedRuns(RunGeneration<Record> & generation,
+             const size_t budget,
+             const Less & less)
+      : _generation(generation), _budget(budget / 2), _less(less), _bytes(0)
+  {
+    const size_t capacity =
+        std::max(_budget / sizeof(Record), min_run_records);
+    _records.reserve(capacity);
+    _scratch.reserve(capacity);
+  }
+
+  void add(const Record & record)
+  {
+    _records.push_back(record);
+    _bytes += record_bytes(record);
+    if(_records.size() == _records.capacity() ||
+       (_records.size() >= min_run_records && _bytes >= _budget))
+    {
+      write();
+    }
+  }
+
+  /**
+     Writes out whatever's left.
+  */
+  void finish()
+  {
+    if(!_records.empty())
+      write();
+  }
+
+  private:
+  void write()
+  {
+    sort_records(_records, _scratch, _less);
+    boost::scoped_ptr<RecordWriter<Record> > run(_generation.next_run());
+    for(size_t i = 0; i < _records.size(); ++i)
+      run->write(_records[i]);
+    _generation.finish_run(*run);
+    _records.clear();
+    _bytes = 0;
+  }
+
+  RunGeneration<Record> & _generation;
+  const size_t _budget;
+  const Less _less;
+
+  std::vector<Record> _records;
+  std::vector<Record> _scratch;
+  size_t _bytes;
+};
+
+/**
+   The body of each run generating worker, which hands every record it's
+   given to a `Runs`, a ReplacementSelection or SortedRuns, and has it write
+   out all it holds whenever there's a checkpoint.
+*/
+template <class Runs, class Record, class Less>
+void make_runs(RunGeneration<Record> & generation,
+               const size_t budget,
+               const Less & less)
+{
+  std::vector<Record> block;
+  try {
+    Runs runs(generation, budget, less);
+    while(generation.next_block(block))
+    {
+      if(block.empty()) {
+        runs.finish();
+        generation.flush_done();
+        continue;
+      }
+
+      for(size_t i = 0; i < block.size(); ++i)
+        runs.add(block[i]);
+    }
+    runs.finish();
+  }
+  catch(...) {
+    {
+      boost::lock_guard<boost::mutex> lock(generation.mutex);
+      generation.error = boost::current_exception();
+      generation.changed.notify_all();
+    }
+
+    // Keep taking blocks, so whoever is reading the input doesn't wait on us
+    // forever.
+    while(generation.next_block(block)) {}
+  }
+}
+
+/**
+   Tells the workers there's no more input coming, waits for them to finish,
+   and passes on the first error any of them had.
+*/
+template <class Record>
+void finish_runs(RunGeneration<Record> & generation,
+                 boost::thread_group & workers)
+{
+  {
+    boost::lock_guard<boost::mutex> lock(generation.mutex);
+    generation.done = true;
+    generation.changed.notify_all();
+  }
+  workers.join_all();
+
+  if(generation.error)
+    boost::rethrow_exception(generation.error);
+}
+
+/**
+   Has each of the `threads` workers write out everything it holds, and once
+   they all have, records every run written since `saved` in `manifest`, as
+   holding the first `consumed` records of the input.
+*/
+template <class Record>
+void checkpoint_runs(RunGeneration<Record> & generation,
+                     const unsigned int threads,
+                     Manifest & manifest,
+                     size_t & saved,
+                     const uint64_t consumed)
+{
+  std::vector<RunFile> runs;
+  {
+    boost::unique_lock<boost::mutex> lock(generation.mutex);
+    // Nobody can take two of these, since they wait for the checkpoint.
+    for(unsigned int worker = 0; worker < threads; ++worker)
+      generation.blocks.push_back(std::vector<Record>());
+    generation.changed.notify_all();
+
+    while(generation.flushed < threads && !generation.error)
+      generation.changed.wait(lock);
+    if(generation.error)
+      return;
+
+    runs.assign(generation.runs.begin() + saved, generation.runs.end());
+    saved = generation.runs.size();
+  }
+
+  manifest.add_runs(runs, consumed, false);
+
+  boost::lock_guard<boost::mutex> lock(generation.mutex);
+  generation.flushed = 0;
+  ++generation.checkpoint;
+  generation.changed.notify_all();
+}
+
+/**
+   Reads every record from `input`, a block at a time, and hands them to
+   `threads` workers, which each turn what they're given into runs in `temp`,
+   in about `memory` bytes between them. With a `pool`, the runs are written
+   in the background.
+
+   With a `manifest`, the records it says are already in runs are skipped,
+   and every so often the workers write out all they hold and the runs so far
+   are recorded in it, so there's never more than a few memory's worth of
+   records to go over again if we die.
+
+   \return the paths of the runs, including any the manifest already had.
+*/
+template <class Record, class Reader, class Less>
+std::vector<std::string> generate_runs(Reader & input,
+                                       const size_t memory,
+                                       const unsigned int threads,
+                                       const Less & less,
+                                       TempDirectory & temp,
+                                       IoPool * pool = NULL,
+                                       Manifest * manifest = NULL,
+                                       Stats * stats = NULL)
+{
+  uint64_t consumed = 0;
+  if(manifest) {
+    if(manifest->complete()) {
+      if(stats) {
+        stats->records = manifest->consumed();
+        stats->runs = manifest->runs().size();
+      }
+      return manifest->runs();
+    }
+
+    Record record;
+    for(; consumed < manifest->consumed(); ++consumed)
+    {
+      if(!input.read(record)) {
+        throw std::runtime_error(
+            "The input is shorter than when the sort started.");
+      }
+    }
+  }
+
+  // A few blocks for each worker can be waiting to be taken, in up to a
+  // quarter of memory. Each worker needs a buffer to write its runs through,
+  // as does the input to be read through, in about another quarter, and the
+  // rest goes to the runs themselves. However little memory that leaves, the
+  // runs always get at least half of it.
+  const size_t queue_limit = 2 * threads;
+  const size_t block_bytes = std::min<size_t>(
+      std::max<size_t>(memory / 4 / (queue_limit + threads), 4 * 1024),
+      256 * 1024);
+  const size_t run_buffer_bytes = buffer_bytes(memory / 4, threads + 1, pool);
+  const size_t queue_bytes =
+      (queue_limit + threads) * block_bytes +
+      (threads + 1) * run_buffer_bytes * (pool ? 2 : 1);
+  const size_t budget =
+      std::max(memory > queue_bytes ? memory - queue_bytes : 0, memory / 2) /
+      threads;
+
+  // Each checkpoint cuts every worker's runs short, so not too often.
+  const uint64_t checkpoint_bytes = 8 * uint64_t(memory);
+
+  typedef typename std::conditional<
+    Less::radix_sortable && RadixDigits<typename Less::Key>::sortable,
+    SortedRuns<Record, Less>,
+    ReplacementSelection<Record, Less> >::type Runs;
+
+  RunGeneration<Record> generation(
+      queue_limit, temp, pool, run_buffer_bytes, manifest);
+  boost::thread_group workers;
+  for(unsigned int worker = 0; worker < threads; ++worker) {
+    workers.create_thread(boost::bind(make_runs<Runs, Record, Less>,
+                                      boost::ref(generation),
+                                      budget,
+                                      less));
+  }
+
+  std::vector<Record> block;
+  size_t bytes = 0;
+  uint64_t since_checkpoint = 0;
+  size_t saved = 0;
+  try {
+    while(true)
+    {
+      Record record;
+      const bool more = input.read(record);
+      if(more) {
+        const size_t size = record_bytes(record);
+        bytes += size;
+        since_checkpoint += size;
+        ++consumed;
+        block.push_back(record);
+      }
+
+      if(bytes >= block_bytes || (!more && !block.empty())) {
+        boost::unique_lock<boost::mutex> lock(generation.mutex);
+        while(generation.blocks.size() >= generation.queue_limit &&
+              !generation.error)
+        {
+          generation.changed.wait(lock);
+        }
+        // No point reading the rest of the input once a worker's given up.
+        if(generation.error)
+          boost::rethrow_exception(generation.error);
+        generation.blocks.push_back(std::vector<Record>());
+        generation.blocks.back().swap(block);
+        generation.changed.notify_all();
+        block.reserve(generation.blocks.back().size());
+        bytes = 0;
+      }
+
+      if(!more)
+        break;
+
+      if(manifest && since_checkpoint >= checkpoint_bytes && block.empty()) {
+        checkpoint_runs(generation, threads, *manifest, saved, consumed);
+        since_checkpoint = 0;
+      }
+    }
+  }
+  catch(...) {
+    // The workers can't be left waiting for more, whatever went wrong.
+    finish_runs(generation, workers);
+    throw;
+  }
+
+  finish_runs(generation, workers);
+
+  if(stats) {
+    stats->records = consumed;
+    for(size_t run = 0; run < generation.runs.size(); ++run)
+      stats->temp_bytes_written += generation.runs[run].bytes;
+  }
+
+  std::vector<std::string> runs;
+  if(manifest) {
+    manifest->add_runs(std::vector<RunFile>(generation.runs.begin() + saved,
+                                            generation.runs.end()),
+                       consumed,
+                       true);
+    runs = manifest->runs();
+  }
+  else {
+    for(size_t run = 0; run < generation.runs.size(); ++run)
+      runs.push_back(generation.runs[run].path);
+  }
+  if(stats)
+    stats->runs = runs.size();
+  return runs;
+}
+
+
+/**
+   Merges every one of the runs at `runs` into `merge` in a single pass, by
+   keeping the next record from each in a heap. Each run is read through a
+   buffer of `buffer_bytes`, and with a `pool`, read ahead in the background.
+   Records that compare equal come out in the order of the runs they're from.
+
+   \return how many bytes of runs were read.
+*/
+template <class Record, class Less, class Writer>
+uint64_t merge_group(const std::vector<std::string> & runs,
+                 Writer & merge,
+                 const Less & less,
+                 IoPool * pool = NULL,
+                 const size_t buffer_bytes = io_buffer_bytes)
+{
+  typedef std::pair<Record, size_t> Head; // (the next record, its run)
+
+  /// Puts the smallest record on top.
+  struct Order {
+    Order(const Less & the_less) : less(the_less) {}
+
+    bool operator()(const Head & a, const Head & b) const
+    {
+      if(less(b.first, a.first))
+        return true;
+      return !less(a.first, b.first) && a.second > b.second;
+    }
+
+    Less less;
+  } order(less);
+
+  boost::ptr_vector<RecordReader<Record> > files;
+  std::vector<Head> heads;
+  heads.reserve(runs.size());
+  uint64_t bytes = 0;
+  for(size_t run = 0; run < runs.size(); ++run)
+  {
+    files.push_back(new RecordReader<Record>(runs[run], pool, buffer_bytes));
+    bytes += files.back().size();
+    heads.push_back(Head(Record(), run));
+    if(files.back().read(heads.back().first))
+      std::push_heap(heads.begin(), heads.end(), order);
+    else
+      heads.pop_back();
+  }
+
+  while(!heads.empty())
+  {
+    std::pop_heap(heads.begin(), heads.end(), order);
+    Head & head = heads.back();
+    merge.write(head.first);
+
+    if(files[head.second].read(head.first))
+      std::push_heap(heads.begin(), heads.end(), order);
+    else
+      heads.pop_back();
+  }
+
+  merge.finish();
+  return bytes;
+}
+
+/**
+   \return how many runs can be merged at once in `memory`: a buffer of at
+   least `min_buffer_bytes` for each run, and one to write to, or two of each
+   when reading and writing in the background with a `pool`. Too many open
+   files at once and we run out, though.
+*/
+inline size_t fan_in(const size_t memory, const IoPool * pool = NULL)
+{
+  const size_t buffers = memory / min_buffer_bytes / (pool ? 2 : 1);
+  return std::min<size_t>(std::max<size_t>(buffers, 3) - 1, 512);
+}
+
+/**
+   Merges the runs at `runs`, as many at a time as there's `memory` to buffer,
+   until the last pass can write them all to `output`, and removes them.
+   Usually that's a single pass: each merge splits `memory` between the runs
+   it reads, so the fewer there are, the bigger their buffers. Any passes
+   before that leave their runs in `temp`, and with a `manifest`, each of
+   those merges is recorded in it as it's done.
+
+   \return how many passes it took.
+*/
+template <class Record, class Less, class Writer>
+size_t merge_runs(std::vector<std::string> runs,
+                  const size_t memory,
+                  Writer & output,
+                  const Less & less,
+                  TempDirectory & temp,
+                  IoPool * pool = NULL,
+                  Manifest * manifest = NULL,
+                  Stats * stats = NULL)
+{
+  const size_t runs_per_merge = fan_in(memory, pool);
+  uint64_t read = 0, written = 0;
+  size_t passes = 1;
+
+  while(runs.size() > runs_per_merge)
+  {
+    std::vector<std::string> merged;
+    for(size_t first = 0; first < runs.size(); first += runs_per_merge)
+    {
+      const std::vector<std::string> group(
+          runs.begin() + first,
+          runs.begin() + std::min(first + runs_per_merge, runs.size()));
+      const size_t group_buffer_bytes =
+          buffer_bytes(memory, group.size() + 1, pool);
+      RecordWriter<Record> merge(temp.make("merge"), pool, group_buffer_bytes);
+      if(manifest)
+        merge.make_durable();
+      read += merge_group<Record>(group, merge, less, pool, group_buffer_bytes);
+      written += merge.bytes();
+      merged.push_back(merge.name());
+
+      if(manifest) {
+        manifest->merged(
+            group, RunFile(merge.name(), merge.bytes(), merge.checksum()));
+      }
+      else {
+        for(size_t run = 0; run < group.size(); ++run)
+          remove(group[run].c_str());
+      }
+    }
+    runs.swap(merged);
+    ++passes;
+    if(manifest)
+      manifest->pass_done();
+  }
+
+  read += merge_group<Record>(
+      runs, output, less, pool, buffer_bytes(memory, runs.size() + 1, pool));
+  for(size_t run = 0; run < runs.size(); ++run)
+    remove(runs[run].c_str());
+
+  if(stats) {
+    stats->temp_bytes_read += read;
+    stats->temp_bytes_written += written;
+  }
+  return passes;
+}
+
+
+/**
+   \param input where to read the records from.
+   \param output where to write them to, in order. It's finished once they're
+   all written.
+   \param options how much memory and how many threads to use, where to put
+   the runs, and whether to pick up from a sort of the same input that died.
+   \param key gives back the key to sort each record by.
+   \param compare orders the keys.
+   \return how many passes the merge took.
+
+   Sorts every record `input` has into `output`. See above for how. Whatever
+   happens, every run is cleaned up on the way out, unless it's needed to
+   resume from.
+*/
+template <class Record,
+          class KeyFn = Identity<Record>,
+          class Compare = std::less<typename KeyOf<Record, KeyFn>::type>,
+          class Reader,
+          class Writer>
+size_t external_sort(Reader & input,
+                     Writer & output,
+                     const Options & options = Options(),
+                     const KeyFn & key = KeyFn(),
+                     const Compare & compare = Compare())
+{
+  typedef RecordLess<Record, KeyFn, Compare> Less;
+  const Less less(key, compare);
+  const unsigned int threads = std::max(options.threads, 1u);
+  const bool resumable = !options.resume_directory.empty();
+
+  boost::scoped_ptr<IoPool> own_pool(
+      options.pool ? NULL : make_io_pool(options.io_threads));
+  IoPool * const pool = options.pool ? options.pool : own_pool.get();
+  TempDirectory temp(
+      resumable ? options.resume_directory : options.temp_directory,
+      resumable);
+
+  // Records of some other size can't be picked up from either.
+  boost::scoped_ptr<Manifest> manifest;
+  if(resumable) {
+    manifest.reset(new Manifest(
+        temp,
+        options.fingerprint + " " +
+        boost::lexical_cast<std::string>(sizeof(Record))));
+  }
+
+  Stats stats;
+  const double start = seconds();
+  const std::vector<std::string> runs = generate_runs<Record>(
+      input,
+      options.memory,
+      threads,
+      less,
+      temp,
+      pool,
+      manifest.get(),
+      &stats);
+  const double generated = seconds();
+  stats.passes = merge_runs<Record>(
+      runs,
+      options.memory,
+      output,
+      less,
+      temp,
+      pool,
+      manifest.get(),
+      &stats);
+  temp.finished();
+
+  // The manifest's count includes any passes made before we died.
+  if(manifest)
+    stats.passes = manifest->passes() + 1;
+  stats.generation_seconds = generated - start;
+  stats.merge_seconds = seconds() - generated;
+  if(options.stats)
+    *options.stats = stats;
+  return stats.passes;
+}
+
+}
+
+#endif
@@ -0,0 +1,329 @@
+// Project
+#include "external_sort.h"
+
+// STL
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// POSIX
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+// boost
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+#include <boost/random/mersenne_twister.hpp>
+
+using namespace std;
+
+
+namespace {
+
+typedef boost::random::mt19937_64 Random_t;
+
+/**
+   The ways the keys in an input can be laid out.
+*/
+const char * const distributions[] = {
+  "uniform", "skewed", "duplicates", "presorted", "reversed"
+};
+const char * const * const distributions_end =
+    distributions + sizeof(distributions) / sizeof(distributions[0]);
+
+/**
+   What a generated input holds, to check the sorted output against.
+*/
+struct Input {
+  Input() : records(0), sum(0) {}
+
+  uint64_t records;
+  uint64_t sum;
+};
+
+/**
+   \param path where to write the input.
+   \param records how many 64-bit keys to write.
+   \param distribution one of `distributions`.
+   \param distinct how many different keys "duplicates" picks from.
+   \return how many keys were written, and what they add up to.
+
+   Writes `records` keys laid out as `distribution` says:
+
+   - uniform: any 64-bit number, as likely as any other;
+   - skewed: a random number shifted right by a random amount, so most are
+     small, and every power of two is about as likely as any other;
+   - duplicates: one of only `distinct` numbers;
+   - presorted: 0, 1, 2 and so on;
+   - reversed: the same, backwards.
+*/
+Input generate(const string & path,
+               const uint64_t records,
+               const string & distribution,
+               const uint64_t distinct,
+               Random_t & random)
+{
+  external::RecordWriter<uint64_t> file(path);
+  Input input;
+  for(uint64_t i = 0; i < records; ++i)
+  {
+    uint64_t key;
+    if(distribution == "uniform")
+      key = random();
+    else if(distribution == "skewed")
+      key = random() >> (random() % 64);
+    else if(distribution == "duplicates")
+      key = random() % distinct;
+    else if(distribution == "presorted")
+      key = i;
+    else
+      key = records - i;
+
+    file.write(key);
+    ++input.records;
+    input.sum += key;
+  }
+  file.finish();
+  return input;
+}
+
+/**
+   \return whether the keys at `path` are in order, and are the same number of
+   keys, adding up to the same thing, as `input`.
+*/
+bool sorted(const string & path, const Input & input)
+{
+  external::RecordReader<uint64_t> file(path);
+  Input output;
+  uint64_t key, last = 0;
+  while(file.read(key))
+  {
+    if(output.records && key < last)
+      return false;
+    last = key;
+    ++output.records;
+    output.sum += key;
+  }
+  return output.records == input.records && output.sum == input.sum;
+}
+
+/**
+   \param input the keys to sort.
+   \param output where to write them sorted.
+   \param stats filled in with what the sort did.
+   \param peak_rss_mb set to the most memory the sort had resident, in
+   megabytes.
+   \return false if the sort failed.
+
+   Sorts in a process of its own, so that its peak memory is its own, and not
+   whatever the biggest sort before it needed.
+*/
+bool measure(const string & input,
+             const string & output,
+             external::Options options,
+             external::Stats & stats,
+             double & peak_rss_mb)
+{
+  int results[2];
+  if(pipe(results) != 0)
+    return false;
+
+  const pid_t child = fork();
+  if(child < 0) {
+    close(results[0]);
+    close(results[1]);
+    return false;
+  }
+
+  if(child == 0) {
+    close(results[0]);
+    try {
+      // Reads and writes with the same threads as the sort, and in the same
+      // memory, so the peak is what all of `options.memory` comes to.
+      boost::scoped_ptr<external::IoPool> pool(
+          external::make_io_pool(options.io_threads));
+      const size_t outer =
+          external::outer_buffer_bytes(options.memory, pool.get());
+      external::RecordReader<uint64_t> in(input, pool.get(), outer);
+      external::RecordWriter<uint64_t> out(output, pool.get(), outer);
+      options.stats = &stats;
+      options.pool = pool.get();
+      options.memory = external::sort_memory(options.memory, pool.get());
+      external::external_sort<uint64_t>(in, out, options);
+      const bool sent = write(results[1], &stats, sizeof(stats)) ==
+          ssize_t(sizeof(stats));
+      _exit(sent ? 0 : 1);
+    }
+    catch(const std::exception & error) {
+      cerr << error.what() << endl;
+      _exit(1);
+    }
+  }
+
+  close(results[1]);
+  const bool received = read(results[0], &stats, sizeof(stats)) ==
+      ssize_t(sizeof(stats));
+  close(results[0]);
+
+  int status;
+  rusage usage;
+  if(wait4(child, &status, 0, &usage) != child)
+    return false;
+  peak_rss_mb = usage.ru_maxrss / 1024.0;
+  return received && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+  boost::program_options::variables_map option_map;
+  try {
+    boost::program_options::options_description description(
+        "External sort benchmark options");
+
+    description.add_options()
+        ("help", "produce help message")
+
+        ("min_mb",
+         boost::program_options::value<uint64_t>()->default_value(1024),
+         "the size of the smallest input to sort, in megabytes.")
+
+        ("max_mb",
+         boost::program_options::value<uint64_t>()->default_value(51200),
+         "the size of the biggest input to sort, in megabytes. Sizes double "
+         "from min_mb, and finish with this one.")
+
+        ("distributions",
+         boost::program_options::value<string>()->default_value(
+             "uniform,skewed,duplicates,presorted,reversed"),
+         "which of uniform, skewed, duplicates, presorted and reversed keys "
+         "to sort, separated by commas.")
+
+        ("distinct",
+         boost::program_options::value<uint64_t>()->default_value(1024),
+         "how many different keys there are in the duplicates input.")
+
+        ("memory",
+         boost::program_options::value<size_t>()->default_value(256),
+         "roughly how many megabytes each sort may use.")
+
+        ("threads",
+         boost::program_options::value<unsigned int>()->default_value(1),
+         "how many threads to make runs with.")
+
+        ("io_threads",
+         boost::program_options::value<unsigned int>()->default_value(2),
+         "how many threads to read ahead and write behind with, or 0 for "
+         "none.")
+
+        ("directory",
+         boost::program_options::value<string>()->default_value("."),
+         "where to put the inputs, outputs and runs; somewhere on the disk "
+         "to measure, with room for three times max_mb.")
+
+        ("seed",
+         boost::program_options::value<unsigned int>()->default_value(5489),
+         "the random seed.");
+
+    boost::program_options::store(
+        boost::program_options::parse_command_line(argc, argv, description),
+        option_map);
+
+    if(option_map.count("help")) {
+      cout << description << endl;
+      return 1;
+    }
+
+    boost::program_options::notify(option_map);
+  }
+  catch(const boost::program_options::error & error) {
+    cerr << error.what() << endl;
+    return 1;
+  }
+
+  vector<string> chosen;
+  const string distribution_list = option_map["distributions"].as<string>();
+  boost::split(chosen, distribution_list, boost::is_any_of(","));
+  for(size_t i = 0; i < chosen.size(); ++i) {
+    if(find(distributions, distributions_end, chosen[i]) ==
+       distributions_end)
+    {
+      cerr << "No such distribution: " << chosen[i] << endl;
+      return 1;
+    }
+  }
+
+  external::Options options;
+  options.memory = option_map["memory"].as<size_t>() * 1024 * 1024;
+  options.threads = max(option_map["threads"].as<unsigned int>(), 1u);
+  options.io_threads = option_map["io_threads"].as<unsigned int>();
+  options.temp_directory = option_map["directory"].as<string>();
+
+  const string input_path = options.temp_directory + "/bench_input";
+  const string output_path = options.temp_directory + "/bench_output";
+  const uint64_t distinct =
+      max<uint64_t>(option_map["distinct"].as<uint64_t>(), 1);
+  Random_t random(option_map["seed"].as<unsigned int>());
+
+  // How far over --memory each sort's peak went, in megabytes; negative if it
+  // stayed under.
+  const double memory_mb = option_map["memory"].as<size_t>();
+
+  cout << setw(9) << "size_mb"
+       << setw(14) << "distribution"
+       << setw(12) << "gen_mb/s"
+       << setw(12) << "merge_mb/s"
+       << setw(10) << "total_s"
+       << setw(8) << "passes"
+       << setw(8) << "runs"
+       << setw(12) << "temp_w_mb"
+       << setw(12) << "temp_r_mb"
+       << setw(13) << "peak_rss_mb"
+       << setw(13) << "rss_over_mb" << endl;
+
+  const uint64_t min_mb = max<uint64_t>(option_map["min_mb"].as<uint64_t>(), 1);
+  const uint64_t max_mb = option_map["max_mb"].as<uint64_t>();
+  for(uint64_t size_mb = min_mb; size_mb <= max_mb;
+      size_mb = size_mb < max_mb ? min(size_mb * 2, max_mb) : max_mb + 1)
+  {
+    const uint64_t records = size_mb * 1024 * 1024 / sizeof(uint64_t);
+    for(size_t i = 0; i < chosen.size(); ++i)
+    {
+      const Input input =
+          generate(input_path, records, chosen[i], distinct, random);
+
+      external::Stats stats;
+      double peak_rss_mb = 0;
+      const bool measured =
+          measure(input_path, output_path, options, stats, peak_rss_mb);
+      remove(input_path.c_str());
+      if(!measured || !sorted(output_path, input)) {
+        remove(output_path.c_str());
+        cerr << "Sorting " << size_mb << "MB of " << chosen[i]
+             << " keys didn't work." << endl;
+        return -1;
+      }
+      remove(output_path.c_str());
+
+      cout << setw(9) << size_mb
+           << setw(14) << chosen[i]
+           << setw(12) << fixed << setprecision(1)
+           << size_mb / stats.generation_seconds
+           << setw(12) << size_mb / stats.merge_seconds
+           << setw(10) << setprecision(2)
+           << stats.generation_seconds + stats.merge_seconds
+           << setw(8) << stats.passes
+           << setw(8) << stats.runs
+           << setw(12) << setprecision(1)
+           << stats.temp_bytes_written / (1024.0 * 1024.0)
+           << setw(12) << stats.temp_bytes_read / (1024.0 * 1024.0)
+           << setw(13) << peak_rss_mb
+           << setw(13) << peak_rss_mb - memory_mb << endl;
+    }
+  }
+
+  return 0;
+}
@@ -2,70 +2,197 @@
 #include <string>
 #include <vector>
 #include <algorithm>
-#include <stack>
+#include <functional>
+
+#include <stdint.h>
+
+#include "../edit_distance/hirschberg.h"
 
 using namespace std;
 
 /**
-   Dynamic programming implementation of a solution for the longest common
-   sub-sequence problem.
+   \param lhs one string.
+   \param rhs the other.
+   \param lengths resized to |rhs| + 1, with element `j` set to the length of
+   the longest common subsequence of `lhs` and the first `j` characters of
+   `rhs`: the table's last row.
+
+   Works out 64 rows of the table at a time, as Hyyro does: bit `i` of `v` is
+   clear if row `i + 1` is one longer than row `i`, in the column so far, and
+   adding the matching bits to it carries each one down to the next clear bit
+   below. The number of clear bits is the length so far.
 */
-int
-longest_common_subsequence(const string & lhs, const string & rhs)
+void last_row(const string & lhs, const string & rhs, vector<size_t> & lengths)
 {
-  if(lhs.empty() || rhs.empty())
-    return 0;
+  lengths.assign(rhs.size() + 1, 0);
+  if(lhs.empty())
+    return;
 
-  vector< vector<int> > dp_table(
-      lhs.size()+1, vector<int>(rhs.size() + 1, 0));
+  const size_t bits = 64;
+  const size_t blocks = (lhs.size() + bits - 1) / bits;
 
-  for(int i = 1; i <= lhs.size(); ++i) 
+  // matches[symbol * blocks + b] has bit r set if character b * 64 + r of lhs
+  // is symbol; only characters in lhs get a symbol, and the rest match nothing.
+  vector<size_t> symbols(256, 0);
+  size_t alphabet = 1;
+  for(size_t i = 0; i < lhs.size(); ++i) {
+    size_t & symbol = symbols[static_cast<unsigned char>(lhs[i])];
+    if(!symbol)
+      symbol = alphabet++;
+  }
+  vector<uint64_t> matches(alphabet * blocks, 0);
+  for(size_t i = 0; i < lhs.size(); ++i) {
+    const size_t symbol = symbols[static_cast<unsigned char>(lhs[i])];
+    matches[symbol * blocks + i / bits] |= uint64_t(1) << (i % bits);
+  }
+
+  // The bits past the end of lhs never match, so they stay set.
+  vector<uint64_t> v(blocks, ~uint64_t(0));
+  for(size_t j = 0; j < rhs.size(); ++j) {
+    const uint64_t * const match =
+        &matches[symbols[static_cast<unsigned char>(rhs[j])] * blocks];
+    uint64_t carry = 0;
+    size_t set = 0;
+    for(size_t b = 0; b < blocks; ++b) {
+      const uint64_t u = v[b] & match[b];
+      const uint64_t partial = v[b] + u;
+      const uint64_t sum = partial + carry;
+      carry = (partial < v[b]) | (sum < partial);
+      v[b] = sum | (v[b] & ~match[b]);
+      set += __builtin_popcountll(v[b]);
+    }
+    lengths[j + 1] = blocks * bits - set;
+  }
+}
+
+/**
+   \param lhs one string.
+   \param rhs the other.
+   \param subsequence where to add their longest common subsequence.
+
+   Fills in the whole table and walks back from the bottom right corner.
+*/
+void traceback(const string & lhs, const string & rhs, string & subsequence)
+{
+  const size_t columns = rhs.size() + 1;
+  vector<size_t> dp_table((lhs.size() + 1) * columns, 0);
+  for(size_t i = 1; i <= lhs.size(); ++i)
   {
-    for(int j = 1; j <= rhs.size(); ++j) 
+    for(size_t j = 1; j <= rhs.size(); ++j)
     {
+      size_t & here = dp_table[i * columns + j];
       if(lhs[i-1] == rhs[j-1])
-        dp_table[i][j] = dp_table[i-1][j-1] + 1;
+        here = dp_table[(i-1) * columns + j-1] + 1;
       else
-        dp_table[i][j] = max(dp_table[i-1][j], dp_table[i][j-1]);
+        here = max(dp_table[(i-1) * columns + j], dp_table[i * columns + j-1]);
     }
   }
 
-  stack<char> subsequence;
-  int i = lhs.size();
-  int j = rhs.size();
+  const size_t start = subsequence.size();
+  size_t i = lhs.size();
+  size_t j = rhs.size();
   while(i > 0 && j > 0)
   {
-    if(dp_table[i][j] == (dp_table[i-1][j-1] + 1) && lhs[i-1] == rhs[j-1]) {
+    if(lhs[i-1] == rhs[j-1]) {
       i -= 1;
       j -= 1;
-      subsequence.push(lhs[i]);
+      subsequence.push_back(lhs[i]);
     }
-    else if(dp_table[i-1][j] > dp_table[i][j-1]) {
+    else if(dp_table[(i-1) * columns + j] > dp_table[i * columns + j-1]) {
       --i;
     }
     else {
       --j;
     }
   }
+  reverse(subsequence.begin() + start, subsequence.end());
+}
 
+/**
+   \param lhs one string.
+   \param rhs the other.
+   \param threads how many threads to work it out with.
+   \return the longest subsequence of both, found in O(|lhs| + |rhs|) memory.
 
-  while(!subsequence.empty()){
-    cout << subsequence.top();
-    subsequence.pop();
-  }
-  cout << endl;
+   The same divide and conquer as an edit script's, except the split is where
+   the two halves' lengths add up to most.
+*/
+string common_subsequence(const string & lhs,
+                          const string & rhs,
+                          const unsigned int threads = 1)
+{
+  string subsequence;
+  edit::hirschberg(lhs, rhs, last_row, traceback, greater<size_t>(),
+                   max(threads, 1u), subsequence);
+  return subsequence;
+}
+
+/**
+   \param out where to write the diff.
+   \param lhs the old string.
+   \param rhs the new one.
+   \param subsequence a longest common subsequence of the two.
 
+   Writes a line per run, the way diff does: characters of the subsequence
+   start with a space, characters only `lhs` has with a '-', and characters
+   only `rhs` has with a '+'. Each string's characters are matched up with the
+   subsequence's as early as they can be.
+*/
+void write_diff(ostream & out,
+                const string & lhs,
+                const string & rhs,
+                const string & subsequence)
+{
+  size_t i = 0;
+  size_t j = 0;
+  for(size_t k = 0; k <= subsequence.size(); ++k) {
+    const bool last = k == subsequence.size();
+    const size_t old_end = last ? lhs.size() : lhs.find(subsequence[k], i);
+    const size_t new_end = last ? rhs.size() : rhs.find(subsequence[k], j);
+    if(old_end > i)
+      out << '-' << lhs.substr(i, old_end - i) << '\n';
+    if(new_end > j)
+      out << '+' << rhs.substr(j, new_end - j) << '\n';
+    if(last)
+      break;
+
+    // Run the subsequence's characters together for as long as both strings
+    // carry on with them.
+    size_t length = 1;
+    while(k + length < subsequence.size() &&
+          old_end + length < lhs.size() &&
+          new_end + length < rhs.size() &&
+          lhs[old_end + length] == subsequence[k + length] &&
+          rhs[new_end + length] == subsequence[k + length])
+    {
+      ++length;
+    }
+    out << ' ' << subsequence.substr(k, length) << '\n';
+    i = old_end + length;
+    j = new_end + length;
+    k += length - 1;
+  }
+}
 
-  return dp_table[lhs.size()][rhs.size()];
+/**
+   Prints the longest common sub-sequence of `lhs` and `rhs`, and returns its
+   length.
+*/
+int
+longest_common_subsequence(const string & lhs, const string & rhs)
+{
+  const string subsequence = common_subsequence(lhs, rhs);
+  cout << subsequence << endl;
+  return subsequence.size();
 }
 
-int main() 
+int main()
 {
-  cout << 
-      longest_common_subsequence(
-          "abgbcdf",
-          "abbcdeeeeeeeeeeeeeeeeeeeeeeeeef")
-       << endl;
+  const string lhs = "abgbcdf";
+  const string rhs = "abbcdeeeeeeeeeeeeeeeeeeeeeeeeef";
+
+  cout << longest_common_subsequence(lhs, rhs) << endl;
+  write_diff(cout, lhs, rhs, common_subsequence(lhs, rhs));
 
   return 0;
 }